@@ -0,0 +1,987 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Microbenchmarks for m_wol.c running against the stub ircd.
+
+   usage: wol_bench [divisor]
+
+   The divisor scales every scenario down for a quick run. Each line reports
+   the cost of the timed operation only, setup is not counted. The scenarios
+   also check what the features they run answer, outside the timed parts,
+   and the exit status is 1 if any of that didn't hold.
+*/
+
+#include <stdint.h>
+#include <errno.h>
+#include "stub/stub.h"
+
+#define USERS           10000
+#define CHURN           100000
+#define ROOMS           5000
+#define LISTS           200
+#define GAMES           1000
+#define PLAYERS         8
+#define LOBBIES         4
+#define LOBBY_USERS     250
+
+typedef struct bench_mark
+{
+    uint64_t            ns;
+    unsigned long       allocs;
+    unsigned long       appends;
+    unsigned long long  bytes;
+} bench_mark;
+
+static int scale = 1;
+static int failed;
+
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_start(bench_mark *mark)
+{
+    mark->allocs = stub_allocs;
+    mark->appends = stub_appends;
+    mark->bytes = stub_bytes;
+    mark->ns = bench_now();
+}
+
+static void bench_print(const char *name, unsigned long ops, uint64_t ns,
+        unsigned long allocs, unsigned long appends, unsigned long long bytes)
+{
+    if (ops == 0)
+        ops = 1;
+
+    printf("%-26s %8lu ops %10.1f ns/op %7.2f allocs/op %8.1f appends/op %9.1f bytes/op %9.1f MB/s\n",
+            name,
+            ops,
+            (double)ns / ops,
+            (double)allocs / ops,
+            (double)appends / ops,
+            (double)bytes / ops,
+            ns ? bytes * 1000.0 / ns : 0.0);
+}
+
+static void bench_report(bench_mark *mark, const char *name, unsigned long ops)
+{
+    bench_print(name, ops, bench_now() - mark->ns,
+            stub_allocs - mark->allocs, stub_appends - mark->appends, stub_bytes - mark->bytes);
+}
+
+/* for a mark that adds up the timed parts of a loop itself */
+static void bench_total(bench_mark *mark, const char *name, unsigned long ops)
+{
+    bench_print(name, ops, mark->ns, mark->allocs, mark->appends, mark->bytes);
+}
+
+/* a check that didn't hold, the run goes on and exits with 1 */
+static void bench_fail(const char *fmt, ...)
+{
+    va_list vl;
+
+    va_start(vl, fmt);
+    vfprintf(stderr, fmt, vl);
+    va_end(vl);
+    fputc('\n', stderr);
+    failed++;
+}
+
+static char *capture_buf;
+static size_t capture_len;
+
+/* everything sent from here to bench_captured is kept */
+static void bench_capture(void)
+{
+    free(capture_buf);
+    capture_buf = NULL;
+    if ((stub_capture = open_memstream(&capture_buf, &capture_len)) == NULL)
+        bench_fail("capture: %s", strerror(errno));
+}
+
+/* valid until the next bench_capture */
+static const char *bench_captured(void)
+{
+    if (stub_capture)
+        fclose(stub_capture);
+    stub_capture = NULL;
+
+    return capture_buf ? capture_buf : "";
+}
+
+/* sends a command, want has to be in what comes back or, when NULL, no
+   reply at all may come back to the client. Returns what the handler did */
+static int bench_expect(aClient *cptr, const char *want, const char *fmt, ...)
+{
+    char line[BUFSIZE + 1], nick[NICKLEN + 1], to[NICKLEN + 8];
+    const char *out;
+    va_list vl;
+    int ret;
+
+    va_start(vl, fmt);
+    vsnprintf(line, sizeof(line), fmt, vl);
+    va_end(vl);
+
+    /* the client can be gone after the command */
+    strlcpy(nick, cptr->name, sizeof(nick));
+    snprintf(to, sizeof(to), "-> %s ", nick);
+
+    bench_capture();
+    ret = stub_command(cptr, "%s", line);
+    out = bench_captured();
+
+    if (want ? strstr(out, want) == NULL : strstr(out, to) != NULL)
+        bench_fail("%s %s: wanted %s, got \"%s\"", nick, line, want ? want : "no reply", out);
+
+    return ret;
+}
+
+/* the scenarios time the commands, not login admission. Every client
+   logs in from an address of its own, so the per address limits at their
+   highest are never reached */
+static void bench_unthrottle(void)
+{
+    stub_setting("login-rate", "1000000");
+    stub_setting("login-burst", "1000000");
+    stub_setting("login-ip-rate", "100000");
+    stub_setting("login-ip-burst", "100000");
+    stub_tick();
+}
+
+static aClient *bench_login(const char *fmt, int n, int registered)
+{
+    char nick[NICKLEN + 1];
+    char ip[32];
+    aClient *cptr;
+
+    snprintf(nick, sizeof(nick), fmt, n);
+    snprintf(ip, sizeof(ip), "10.%d.%d.%d", (n >> 16) & 255, (n >> 8) & 255, n & 255);
+
+    cptr = stub_client(nick, ip, registered);
+    stub_command(cptr, "CVERS 11015 5376");
+    stub_flush(cptr);
+
+    return cptr;
+}
+
+/* 10k logins and quits, then steady state churn on a full server */
+static void bench_login_churn(void)
+{
+    int users = USERS / scale, churn = CHURN / scale, i;
+    aClient **ring = calloc(users, sizeof(aClient *));
+    char nick[NICKLEN + 1];
+    char ip[32];
+    bench_mark mark;
+
+    for (i = 0; i < users; i++)
+    {
+        snprintf(nick, sizeof(nick), "u%d", i);
+        snprintf(ip, sizeof(ip), "10.%d.%d.%d", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+        ring[i] = stub_client(nick, ip, 0);
+    }
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+        stub_command(ring[i], "CVERS 11015 5376");
+    bench_report(&mark, "CVERS login", users);
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+        exit_client(ring[i], ring[i], &me, "Quit");
+    bench_report(&mark, "quit", users);
+
+    for (i = 0; i < users; i++)
+        ring[i] = bench_login("u%d", i, 0);
+
+    bench_start(&mark);
+    for (i = 0; i < churn; i++)
+    {
+        int slot = i % users;
+        exit_client(ring[slot], ring[slot], &me, "Quit");
+        ring[slot] = bench_login("c%d", i, 0);
+    }
+    bench_report(&mark, "quit+login churn", churn);
+
+    for (i = 0; i < users; i++)
+        exit_client(ring[i], ring[i], &me, "Quit");
+
+    free(ring);
+}
+
+/* LIST from the lobby while 5k game rooms are open */
+static void bench_list(void)
+{
+    int rooms = ROOMS / scale, lists = LISTS, i;
+    aClient **hosts = calloc(rooms, sizeof(aClient *));
+    aClient *lobby;
+    bench_mark mark;
+
+    for (i = 0; i < rooms; i++)
+    {
+        hosts[i] = bench_login("host%d", i, 1);
+        stub_command(hosts[i], "JOINGAME #game%d 2 8 21 3 0 0 0", i);
+        stub_flush(hosts[i]);
+    }
+
+    lobby = bench_login("lobby", 0, 1);
+
+    bench_start(&mark);
+    for (i = 0; i < lists; i++)
+    {
+        stub_command(lobby, "LIST 21 21");
+        stub_flush(lobby);
+    }
+    bench_report(&mark, "LIST 21 with 5k rooms", lists);
+
+    bench_start(&mark);
+    for (i = 0; i < lists; i++)
+    {
+        stub_command(lobby, "LIST 33 33");
+        stub_flush(lobby);
+    }
+    bench_report(&mark, "LIST 33 (no rooms)", lists);
+
+    /* a watching lobby gets only the rooms that changed, ten a tick */
+    stub_command(lobby, "LIST 21 21 WATCH");
+    stub_flush(lobby);
+
+    memset(&mark, 0, sizeof(mark));
+    for (i = 0; i < lists; i++)
+    {
+        bench_mark tick;
+        int j, room;
+
+        for (j = 0; j < 10; j++)
+        {
+            room = (i * 10 + j) % rooms;
+            stub_part(hosts[room], hosts[room]->user->channel->chptr);
+            stub_command(hosts[room], "JOINGAME #game%d 2 8 21 3 0 0 0", room);
+            stub_flush(hosts[room]);
+        }
+
+        bench_start(&tick);
+        stub_tick();
+
+        mark.ns += bench_now() - tick.ns;
+        mark.allocs += stub_allocs - tick.allocs;
+        mark.appends += stub_appends - tick.appends;
+        mark.bytes += stub_bytes - tick.bytes;
+        stub_flush(lobby);
+    }
+    bench_total(&mark, "LIST 21 WATCH tick", lists);
+
+    /* a room that went away is listed with nobody in it */
+    stub_part(hosts[0], hosts[0]->user->channel->chptr);
+    bench_capture();
+    stub_tick();
+    if (strstr(bench_captured(), " 326 lobby #game0 0 0 21 0 0 0 0::") == NULL)
+        bench_fail("list: a room that went away was not sent to a watcher");
+
+    for (i = 0; i < rooms; i++)
+        exit_client(hosts[i], hosts[i], &me, "Quit");
+    exit_client(lobby, lobby, &me, "Quit");
+
+    free(hosts);
+}
+
+/* 1000 users moving through four configured lobbies, and LIST of them */
+static void bench_lobbies(void)
+{
+    static ConfigEntry game[LOBBIES], lobby[LOBBIES], wol;
+    static char names[LOBBIES][CHANNELLEN + 1];
+    int users = LOBBIES * LOBBY_USERS / scale, lists = LISTS, i;
+    aClient **clients = calloc(users, sizeof(aClient *));
+    aClient *cptr;
+    bench_mark mark;
+
+    wol.ce_varname = "wol";
+    wol.ce_entries = &lobby[0];
+
+    for (i = 0; i < LOBBIES; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "#Lob_21_%d", i);
+        game[i].ce_varname = "game";
+        game[i].ce_vardata = "21";
+        lobby[i].ce_varname = "lobby";
+        lobby[i].ce_vardata = names[i];
+        lobby[i].ce_entries = &game[i];
+        lobby[i].ce_next = (i < LOBBIES - 1) ? &lobby[i + 1] : NULL;
+    }
+
+    if (stub_config(&wol) < 0)
+        return;
+
+    for (i = 0; i < users; i++)
+        clients[i] = bench_login("l%d", i, 1);
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+    {
+        stub_command(clients[i], "JOIN %s zotclot9", names[i % LOBBIES]);
+        stub_flush(clients[i]);
+    }
+    bench_report(&mark, "JOIN lobby", users);
+
+    /* joins and parts at the tail of a full lobby, as in steady state */
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+    {
+        stub_part(clients[i], find_channel(names[i % LOBBIES], NULL));
+        stub_command(clients[i], "JOIN %s zotclot9", names[i % LOBBIES]);
+        stub_flush(clients[i]);
+    }
+    bench_report(&mark, "part+JOIN full lobby", users);
+
+    cptr = bench_login("lister", 0, 1);
+
+    bench_start(&mark);
+    for (i = 0; i < lists; i++)
+    {
+        stub_command(cptr, "LIST 0 21");
+        stub_flush(cptr);
+    }
+    bench_report(&mark, "LIST 0 (4 lobbies)", lists);
+
+    for (i = 0; i < users; i++)
+    {
+        stub_flush(clients[i]);
+        exit_client(clients[i], clients[i], &me, "Quit");
+    }
+    exit_client(cptr, cptr, &me, "Quit");
+
+    stub_rehash();
+    free(clients);
+}
+
+/* 1000 games filling up with 8 players each, starting and breaking up */
+/* the nicks of one game's players for STARTG and USERIP */
+static void bench_names(char *list, aClient **players)
+{
+    int j;
+
+    list[0] = '\0';
+    for (j = 0; j < PLAYERS; j++)
+    {
+        strcat(list, players[j]->name);
+        if (j < PLAYERS - 1)
+            strcat(list, ",");
+    }
+}
+
+static void bench_games(void)
+{
+    int games = GAMES / scale, logged = 0, i, j;
+    aClient **players = calloc(games * PLAYERS, sizeof(aClient *));
+    aClient *host, *guest, *late;
+    char list[PLAYERS * (NICKLEN + 1)];
+    char log[] = "/tmp/wol_bench_games.log";
+    char cmd[256];
+    struct timespec nap = { 0, 50000000 };
+    bench_mark mark;
+    FILE *fp;
+
+    for (i = 0; i < games * PLAYERS; i++)
+        players[i] = bench_login("p%d", i, 1);
+
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+        stub_command(players[i * PLAYERS], "JOINGAME #game%d 2 8 21 3 0 0 0", i);
+    bench_report(&mark, "JOINGAME create", games);
+
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        for (j = 1; j < PLAYERS; j++)
+            stub_command(players[i * PLAYERS + j], "JOINGAME #game%d 1", i);
+    }
+    bench_report(&mark, "JOINGAME join", games * (PLAYERS - 1));
+
+    /* every room is full now, a rush on them is turned away */
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        for (j = 0; j < PLAYERS; j++)
+            stub_command(players[((i + 1) % games) * PLAYERS + j], "JOINGAME #game%d 1", i);
+    }
+    bench_report(&mark, "JOINGAME full room", games * PLAYERS);
+
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        for (j = 0; j < PLAYERS; j++)
+            stub_command(players[i * PLAYERS + j], "GAMEOPT #game%d :option%d,%d", i, j, i);
+    }
+    bench_report(&mark, "GAMEOPT to channel", games * PLAYERS);
+
+    /* a host dragging a slider, the tick sends the last position */
+    stub_tick();
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        for (j = 0; j < 20; j++)
+            stub_command(players[i * PLAYERS], "GAMEOPT #game%d :G1P3,%d,0,1,1,0,1,1,1,0,0,0,0", i, j);
+    }
+    stub_tick();
+    bench_report(&mark, "GAMEOPT host burst", games * 20);
+
+    /* every player asks for the others' addresses before the start */
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        bench_names(list, players + i * PLAYERS);
+        for (j = 0; j < PLAYERS; j++)
+            stub_command(players[i * PLAYERS + j], "USERIP %s", list);
+    }
+    bench_report(&mark, "USERIP", games * PLAYERS);
+
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        bench_names(list, players + i * PLAYERS);
+        stub_command(players[i * PLAYERS], "STARTG #game%d %s", i, list);
+    }
+    bench_report(&mark, "STARTG", games);
+
+    /* the same again with every game written to the log by the writer */
+    remove(log);
+    stub_setting("game-log", log);
+    bench_start(&mark);
+    for (i = 0; i < games; i++)
+    {
+        bench_names(list, players + i * PLAYERS);
+        stub_command(players[i * PLAYERS], "STARTG #game%d %s", i, list);
+    }
+    bench_report(&mark, "STARTG logged", games);
+
+    stub_rehash();
+    bench_unthrottle();
+
+    /* the writer keeps going through the rehash, give it a few seconds */
+    snprintf(cmd, sizeof(cmd), "./tools/wol_games -c %s", log);
+    for (i = 0; i < 100 && logged != games; i++)
+    {
+        nanosleep(&nap, NULL);
+        logged = -1;
+        if ((fp = popen(cmd, "r")) != NULL)
+        {
+            if (fscanf(fp, "%d", &logged) != 1)
+                logged = -1;
+            pclose(fp);
+        }
+    }
+    if (logged != games)
+        bench_fail("games: %d of %d games in %s", logged, games, log);
+    remove(log);
+
+    /* a started room, a wrong key and a full room */
+    host = bench_login("joins", 0, 1);
+    guest = bench_login("guest", 0, 1);
+    late = bench_login("late", 0, 1);
+    bench_expect(guest, " 473 ", "JOINGAME #game0 1");
+    stub_command(host, "JOINGAME #joins 1 2 21 3 0 0 0 pw");
+    bench_expect(guest, " 475 ", "JOINGAME #joins 1 bad");
+    bench_expect(guest, ":guest JOINGAME ", "JOINGAME #joins 1 pw");
+    bench_expect(late, " 471 ", "JOINGAME #joins 1 pw");
+    bench_expect(host, "Too many players", "STARTG #joins joins,guest,a,b,c,d,e,f,g,h,i,j,k,l,m,n,o");
+    bench_expect(guest, " 482 ", "STARTG #joins joins,guest");
+    bench_expect(host, ":joins STARTG #joins :joins 10.0.0.0 guest 10.0.0.0 :1 ", "STARTG #joins joins,late,guest");
+    stub_flush(host);
+    stub_flush(guest);
+    stub_flush(late);
+    exit_client(host, host, &me, "Quit");
+    exit_client(guest, guest, &me, "Quit");
+    exit_client(late, late, &me, "Quit");
+
+    bench_start(&mark);
+    for (i = 0; i < games * PLAYERS; i++)
+    {
+        if (players[i]->user->channel)
+            stub_part(players[i], players[i]->user->channel->chptr);
+    }
+    bench_report(&mark, "part", games * PLAYERS);
+
+    for (i = 0; i < games * PLAYERS; i++)
+    {
+        stub_flush(players[i]);
+        exit_client(players[i], players[i], &me, "Quit");
+    }
+
+    free(players);
+}
+
+/* 10k clients logging in at once with the default admission limits, what
+   doesn't fit in the queue is turned away and the rest is let in by the
+   login tick */
+static void bench_storm(void)
+{
+    int users = USERS / scale, ticks = 0, refused = 0, waiting, i;
+    aClient **clients = calloc(users, sizeof(aClient *));
+    char nick[NICKLEN + 1];
+    char ip[32];
+    char name[64];
+    bench_mark mark;
+
+    stub_rehash();
+    stub_tick();
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+    {
+        snprintf(nick, sizeof(nick), "s%d", i);
+        snprintf(ip, sizeof(ip), "10.%d.%d.%d", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+
+        clients[i] = stub_client(nick, ip, 0);
+        if (stub_command(clients[i], "CVERS 11015 5376") < 0)
+        {
+            clients[i] = NULL;
+            refused++;
+        }
+    }
+    bench_report(&mark, "CVERS storm", users);
+
+    bench_start(&mark);
+    do
+    {
+        stub_tick();
+        ticks++;
+
+        for (waiting = 0, i = 0; i < users; i++)
+        {
+            if (clients[i] && clients[i]->since > TStime())
+                waiting++;
+        }
+    }
+    while (waiting && ticks < 3600);
+
+    snprintf(name, sizeof(name), "storm drain (%d ticks)", ticks);
+    bench_report(&mark, name, users - refused);
+    printf("%-26s %8d turned away\n", "", refused);
+
+    if (waiting)
+        bench_fail("storm: %d logins still queued after %d ticks", waiting, ticks);
+
+    for (i = 0; i < users; i++)
+    {
+        if (clients[i])
+        {
+            stub_flush(clients[i]);
+            exit_client(clients[i], clients[i], &me, "Quit");
+        }
+    }
+
+    /* one login a second and no queue, the second one is turned away */
+    stub_setting("login-rate", "1");
+    stub_setting("login-burst", "1");
+    stub_setting("login-queue", "0");
+    stub_tick();
+    clients[0] = stub_client("busy0", "10.255.0.1", 0);
+    clients[1] = stub_client("busy1", "10.255.0.2", 0);
+    bench_expect(clients[0], NULL, "CVERS 11015 5376");
+    if (bench_expect(clients[1], "Server busy", "CVERS 11015 5376") != FLUSH_BUFFER)
+        bench_fail("storm: parsing went on for a client that was turned away");
+    stub_flush(clients[0]);
+    exit_client(clients[0], clients[0], &me, "Quit");
+
+    stub_rehash();
+    free(clients);
+    bench_unthrottle();
+}
+
+/* 5k rooms on the reap wheel, a tenth of them busy every second, then all
+   of them going idle at once */
+static void bench_reaper(void)
+{
+    int rooms = ROOMS / scale, ticks = 60, i, j;
+    aClient **hosts = calloc(rooms, sizeof(aClient *));
+    bench_mark mark;
+
+    stub_setting("room-idle", "60");
+    bench_unthrottle();
+
+    for (i = 0; i < rooms; i++)
+    {
+        hosts[i] = bench_login("idle%d", i, 1);
+        stub_command(hosts[i], "JOINGAME #idle%d 2 8 21 3 0 0 0", i);
+        stub_flush(hosts[i]);
+    }
+
+    memset(&mark, 0, sizeof(mark));
+    for (i = 0; i < ticks; i++)
+    {
+        bench_mark tick;
+
+        for (j = 0; j < rooms / 10; j++)
+            stub_command(hosts[(i * (rooms / 10) + j) % rooms], "GAMEOPT #idle%d :tick%d", (i * (rooms / 10) + j) % rooms, i);
+
+        bench_start(&tick);
+        stub_tick();
+        mark.ns += bench_now() - tick.ns;
+        mark.allocs += stub_allocs - tick.allocs;
+        mark.appends += stub_appends - tick.appends;
+        mark.bytes += stub_bytes - tick.bytes;
+    }
+    bench_total(&mark, "reap tick (5k rooms)", ticks);
+
+    bench_start(&mark);
+    for (i = 0; i < ticks; i++)
+        stub_tick();
+    bench_report(&mark, "reap idle rooms", rooms);
+
+    for (i = 0; i < rooms; i++)
+    {
+        if (hosts[i]->user->channel)
+            bench_fail("reaper: %s is still in a room", hosts[i]->name);
+        stub_flush(hosts[i]);
+        exit_client(hosts[i], hosts[i], &me, "Quit");
+    }
+
+    stub_rehash();
+    bench_unthrottle();
+    free(hosts);
+}
+
+/* module reload with 10k users online, 1000 of them hosting rooms */
+static void bench_reload(void)
+{
+    int users = USERS / scale, rooms = GAMES / scale, i;
+    aClient **clients = calloc(users, sizeof(aClient *));
+    unsigned long long before, after;
+    aClient *lister;
+    bench_mark mark;
+
+    for (i = 0; i < users; i++)
+    {
+        clients[i] = bench_login("r%d", i, 1);
+        if (i < rooms)
+            stub_command(clients[i], "JOINGAME #room%d 2 8 21 3 0 0 0", i);
+        stub_flush(clients[i]);
+    }
+
+    lister = clients[users - 1];
+
+    before = stub_bytes;
+    stub_command(lister, "LIST 21 21");
+    before = stub_bytes - before;
+
+    bench_start(&mark);
+    stub_unload();
+    stub_load();
+    bench_report(&mark, "reload", 1);
+
+    after = stub_bytes;
+    stub_command(lister, "LIST 21 21");
+    after = stub_bytes - after;
+
+    if (before != after)
+        bench_fail("reload: LIST was %llu bytes before and %llu after", before, after);
+
+    /* only WOL users get each other's cached address */
+    bench_expect(clients[0], "r1=+10.0.0.1", "USERIP r1");
+
+    for (i = 0; i < users; i++)
+    {
+        stub_flush(clients[i]);
+        exit_client(clients[i], clients[i], &me, "Quit");
+    }
+
+    free(clients);
+}
+
+/* 5k rooms sent to a new link, the same rooms coming back from it and a
+   sync tick after every one of them started */
+static void bench_sync(void)
+{
+    int rooms = ROOMS / scale, len = 0, i;
+    aClient **hosts = calloc(rooms, sizeof(aClient *));
+    aClient *server, *peer, *guest;
+    char line[BUFSIZE];
+    bench_mark mark;
+
+    bench_unthrottle();
+
+    for (i = 0; i < rooms; i++)
+    {
+        hosts[i] = bench_login("sync%d", i, 1);
+        stub_command(hosts[i], "JOINGAME #sync%d 2 8 21 3 0 0 0", i);
+        stub_flush(hosts[i]);
+    }
+
+    server = stub_server("peer.stub");
+
+    bench_start(&mark);
+    stub_link(server);
+    bench_report(&mark, "WOLROOM burst (5k rooms)", rooms);
+    stub_flush(server);
+
+    bench_start(&mark);
+    for (i = 0; i < rooms; i++)
+    {
+        if (len > BUFSIZE - 128)
+        {
+            stub_command(server, "WOLROOM :%s", line);
+            len = 0;
+        }
+        len += sprintf(line + len, "%s+#sync%d,2,8,21,0,0,16909060,0,0,", len ? " " : "", i);
+    }
+    if (len)
+        stub_command(server, "WOLROOM :%s", line);
+    bench_report(&mark, "WOLROOM apply", rooms);
+
+    /* a key set over there is asked for here */
+    stub_command(server, "WOLROOM :+#sync0,2,8,21,0,0,16909060,0,0,sekrit");
+    guest = bench_login("syncguest", 0, 1);
+    bench_expect(guest, " 475 ", "JOINGAME #sync0 1 wrong");
+    stub_flush(guest);
+    exit_client(guest, guest, &me, "Quit");
+
+    for (i = 0; i < rooms; i++)
+    {
+        stub_command(hosts[i], "STARTG #sync%d sync%d", i, i);
+        stub_flush(hosts[i]);
+    }
+
+    bench_start(&mark);
+    stub_tick();
+    bench_report(&mark, "sync tick (5k started)", rooms);
+
+    /* the next link gets the room as it was applied and started */
+    peer = stub_server("peer2.stub");
+    bench_capture();
+    stub_link(peer);
+    if (strstr(bench_captured(), "+#sync0,2,8,21,0,0,16909060,0,1,sekrit") == NULL)
+        bench_fail("sync: #sync0 is not in the burst as applied and started");
+    stub_flush(peer);
+    exit_client(peer, peer, &me, "Quit");
+
+    for (i = 0; i < rooms; i++)
+    {
+        stub_flush(hosts[i]);
+        exit_client(hosts[i], hosts[i], &me, "Quit");
+    }
+
+    stub_flush(server);
+    exit_client(server, server, &me, "Quit");
+    stub_tick();
+    free(hosts);
+}
+
+/* SERIAL against a database of 100k banned keys, clean keys stop at the
+   filter, banned ones and keys already online are dropped */
+static void bench_serials(void)
+{
+    int banned = USERS * 10 / scale, users = USERS / scale, dropped = 0, online, i;
+    aClient **clients = calloc(users, sizeof(aClient *));
+    char list[] = "/tmp/wol_bench_serials.txt";
+    char db[] = "/tmp/wol_bench_serials.db";
+    char cmd[256];
+    bench_mark mark;
+    FILE *fp;
+
+    if ((fp = fopen(list, "w")) == NULL)
+    {
+        perror(list);
+        return;
+    }
+
+    for (i = 0; i < banned; i++)
+        fprintf(fp, "BANNED-%08d\n", i);
+    fclose(fp);
+
+    snprintf(cmd, sizeof(cmd), "./tools/wol_serials %s %s > /dev/null", list, db);
+    if (system(cmd) != 0 || stub_setting("serials", db) != 0)
+    {
+        bench_fail("serials: could not build %s", db);
+        return;
+    }
+
+    bench_unthrottle();
+    for (i = 0; i < users; i++)
+        clients[i] = bench_login("k%d", i, 1);
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+    {
+        if (stub_command(clients[i], "SERIAL CLEAN-%08d", i) < 0)
+        {
+            clients[i] = NULL;
+            dropped++;
+        }
+    }
+    bench_report(&mark, "SERIAL clean", users);
+
+    if (dropped)
+        bench_fail("serials: %d clean keys dropped", dropped);
+
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+    {
+        if (stub_command(clients[i], "SERIAL CLEAN-%08d", users - i - 1) < 0)
+        {
+            clients[i] = NULL;
+            dropped++;
+        }
+    }
+    bench_report(&mark, "SERIAL in use", users);
+
+    bench_start(&mark);
+    for (online = users - dropped, i = 0; i < users; i++)
+    {
+        if (clients[i] && stub_command(clients[i], "SERIAL BANNED-%08d", i) < 0)
+            clients[i] = NULL;
+    }
+    bench_report(&mark, "SERIAL banned", online);
+
+    for (online = 0, i = 0; i < users; i++)
+        online += clients[i] != NULL;
+    if (online)
+        bench_fail("serials: %d clients still online with a banned key", online);
+
+    clients[0] = bench_login("k%d", 0, 1);
+    clients[1] = bench_login("k%d", 1, 1);
+    bench_expect(clients[0], NULL, "SERIAL CLEAN-%08d", users);
+    bench_expect(clients[1], "Serial is already in use", "SERIAL CLEAN-%08d", users);
+    bench_expect(clients[0], NULL, "SERIAL CLEAN-%08d", users);
+    clients[1] = bench_login("k%d", 1, 1);
+    bench_expect(clients[1], "Serial is banned", "SERIAL BANNED-%08d", banned - 1);
+    clients[1] = NULL;
+
+    for (i = 0; i < users; i++)
+    {
+        if (clients[i])
+        {
+            stub_flush(clients[i]);
+            exit_client(clients[i], clients[i], &me, "Quit");
+        }
+    }
+
+    /* the bans hold through a rehash until it is done without wol::serials */
+    stub_rehash();
+    bench_unthrottle();
+    bench_expect(bench_login("k%d", 0, 1), "Serial is banned", "SERIAL BANNED-%08d", 0);
+    stub_rehash_complete();
+    clients[0] = bench_login("k%d", 0, 1);
+    bench_expect(clients[0], NULL, "SERIAL BANNED-%08d", 0);
+    exit_client(clients[0], clients[0], &me, "Quit");
+
+    remove(list);
+    remove(db);
+    free(clients);
+}
+
+/* APGAR looked up in 100k accounts, the right password, a wrong one and a
+   nick with no account */
+static void bench_accounts(void)
+{
+    int accounts = USERS * 10 / scale, users = USERS / scale, dropped = 0, i;
+    aClient **clients = calloc(users, sizeof(aClient *));
+    char list[] = "/tmp/wol_bench_accounts.txt";
+    char db[] = "/tmp/wol_bench_accounts.db";
+    char cmd[256];
+    bench_mark mark;
+    FILE *fp;
+
+    if ((fp = fopen(list, "w")) == NULL)
+    {
+        perror(list);
+        return;
+    }
+
+    for (i = 0; i < accounts; i++)
+        fprintf(fp, "a%d test\n", i);
+    fclose(fp);
+
+    snprintf(cmd, sizeof(cmd), "./tools/wol_accounts %s %s > /dev/null", list, db);
+    if (system(cmd) != 0 || stub_setting("accounts", db) != 0)
+    {
+        bench_fail("accounts: could not build %s", db);
+        return;
+    }
+
+    bench_unthrottle();
+    for (i = 0; i < users; i++)
+        clients[i] = bench_login("a%d", i * (accounts / users), 1);
+
+    /* "test" */
+    bench_start(&mark);
+    for (i = 0; i < users; i++)
+        dropped += stub_command(clients[i], "APGAR 0aIraaaa 0") < 0;
+    bench_report(&mark, "APGAR account", users);
+
+    if (dropped)
+        bench_fail("accounts: %d of %d right passwords refused", dropped, users);
+
+    bench_start(&mark);
+    for (dropped = 0, i = 0; i < users; i++)
+        dropped += stub_command(clients[i], "APGAR 0aIrbbbb 0") < 0;
+    bench_report(&mark, "APGAR wrong password", users);
+
+    if (dropped != users)
+        bench_fail("accounts: %d of %d wrong passwords refused", dropped, users);
+
+    for (i = 0; i < users; i++)
+        clients[i] = bench_login("x%d", i, 1);
+
+    bench_start(&mark);
+    for (dropped = 0, i = 0; i < users; i++)
+        dropped += stub_command(clients[i], "APGAR 0aIraaaa 0") < 0;
+    bench_report(&mark, "APGAR no account", users);
+
+    if (dropped != users)
+        bench_fail("accounts: %d of %d nicks without an account refused", dropped, users);
+
+    stub_rehash();
+    bench_unthrottle();
+    stub_rehash_complete();
+
+    /* wol::accounts is gone and "test" is not taken without test-password */
+    bench_expect(bench_login("a%d", 0, 1), "Invalid password", "APGAR 0aIraaaa 0");
+    remove(list);
+    remove(db);
+    free(clients);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && atoi(argv[1]) > 0)
+        scale = atoi(argv[1]);
+
+    stub_load();
+    bench_unthrottle();
+
+    bench_login_churn();
+    bench_list();
+    bench_lobbies();
+    bench_unthrottle();
+    bench_games();
+    bench_reaper();
+    bench_sync();
+    bench_reload();
+    bench_serials();
+    bench_accounts();
+    bench_storm();
+
+    stub_unload();
+
+    if (failed)
+        fprintf(stderr, "%d checks failed\n", failed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Replays a recorded trace of client commands through m_wol.c against the
+   stub ircd as fast as it can and reports throughput, per command latency
+   and peak memory.
+
+   usage: wol_replay [-n passes] tracefile
+
+   One event per line, in the shape WOL_TRACE_PARV writes them:
+
+     0x1c3e0a0  CVERS 11015 5376
+     0x1c3e0a0 nick LIST 21 21
+     0x1c3e0a0 nick QUIT :Quit
+
+   The first field identifies the connection, the second is the nick (empty
+   before registration). Lines copied from WOLTRACE DUMP with the notice
+   prefix and the time, level and category fields are accepted as is. Trace
+   lines that are not commands are skipped. The module does not trace PART
+   so a recording may add "PART #channel" lines by hand.
+
+   Connections still open at the end of a pass are quit before the next one.
+*/
+
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "stub/stub.h"
+#include "../wol_hash.h"
+
+#define REPLAY_COMMANDS 32
+
+typedef struct replay_session
+{
+    uintptr_t           key;
+    aClient             *cptr;
+} replay_session;
+
+typedef struct replay_cmd
+{
+    char                name[16];
+    unsigned long       calls;
+    unsigned long long  bytes;
+    uint64_t            *ns;
+    unsigned long       size;
+} replay_cmd;
+
+static replay_cmd commands[REPLAY_COMMANDS];
+static int ncommands;
+
+static wol_hash sessions;
+static replay_session **live;
+static unsigned long nlive, live_size, peak_live, created;
+
+static uint64_t replay_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static replay_cmd *replay_command(const char *name, int len)
+{
+    int i;
+
+    if (len >= (int)sizeof(commands[0].name))
+        len = sizeof(commands[0].name) - 1;
+
+    for (i = 0; i < ncommands; i++)
+    {
+        if (!strncasecmp(commands[i].name, name, len) && commands[i].name[len] == '\0')
+            return &commands[i];
+    }
+
+    if (ncommands == REPLAY_COMMANDS)
+        return NULL;
+
+    memcpy(commands[ncommands].name, name, len);
+    commands[ncommands].name[len] = '\0';
+
+    return &commands[ncommands++];
+}
+
+static void replay_record(replay_cmd *cmd, uint64_t ns, unsigned long bytes)
+{
+    if (cmd->calls == cmd->size)
+    {
+        cmd->size = cmd->size ? cmd->size * 2 : 1024;
+        cmd->ns = realloc(cmd->ns, cmd->size * sizeof(uint64_t));
+    }
+
+    cmd->ns[cmd->calls++] = ns;
+    cmd->bytes += bytes;
+}
+
+static int replay_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static replay_session *replay_open(uintptr_t key, const char *nick)
+{
+    replay_session *session = calloc(1, sizeof(replay_session));
+    char name[NICKLEN + 1];
+    char ip[32];
+
+    created++;
+    snprintf(name, sizeof(name), "%s", *nick ? nick : "");
+    snprintf(ip, sizeof(ip), "10.%lu.%lu.%lu", (created >> 16) & 255, (created >> 8) & 255, created & 255);
+
+    session->key = key;
+    session->cptr = stub_client(name, ip, *nick != '\0');
+
+    wol_hash_put(&sessions, (void *)key, session);
+
+    if (nlive == live_size)
+    {
+        live_size = live_size ? live_size * 2 : 1024;
+        live = realloc(live, live_size * sizeof(replay_session *));
+    }
+
+    live[nlive++] = session;
+    if (nlive > peak_live)
+        peak_live = nlive;
+
+    return session;
+}
+
+static void replay_close(replay_session *session)
+{
+    unsigned long i;
+
+    wol_hash_del(&sessions, (void *)session->key);
+
+    for (i = 0; i < nlive; i++)
+    {
+        if (live[i] == session)
+        {
+            live[i] = live[--nlive];
+            break;
+        }
+    }
+
+    exit_client(session->cptr, session->cptr, &me, "Quit");
+    free(session);
+}
+
+/* finds the "<ptr> <nick> <command>" part of a trace line */
+static char *replay_event(char *line)
+{
+    char *s;
+    int i;
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (*line == ':')
+    {
+        if ((s = strstr(line, " :")) == NULL)
+            return NULL;
+        line = s + 2;
+    }
+
+    /* time, level and category from WOLTRACE DUMP */
+    if (isdigit((unsigned char)*line) && strncmp(line, "0x", 2))
+    {
+        for (i = 0; i < 3 && line; i++)
+        {
+            line = strchr(line, ' ');
+            if (line)
+                line++;
+        }
+    }
+
+    if (line == NULL || strncmp(line, "0x", 2))
+        return NULL;
+
+    return line;
+}
+
+static void replay_line(char *line)
+{
+    char *nick, *cmdline, *end;
+    replay_session *session;
+    replay_cmd *cmd;
+    uintptr_t key;
+    unsigned long long bytes;
+    uint64_t start;
+    int len;
+
+    if ((line = replay_event(line)) == NULL)
+        return;
+
+    key = (uintptr_t)strtoull(line, &nick, 16);
+    if (key == 0 || *nick != ' ')
+        return;
+
+    nick++;
+    if ((cmdline = strchr(nick, ' ')) == NULL)
+        return;
+    *cmdline++ = '\0';
+
+    /* commands are upper case words, anything else is a plain trace message */
+    for (end = cmdline; isupper((unsigned char)*end); end++);
+    len = end - cmdline;
+    if (len == 0 || (*end != ' ' && *end != '\0'))
+        return;
+
+    session = wol_hash_get(&sessions, (void *)key);
+
+    if (len == 4 && !strncmp(cmdline, "QUIT", 4))
+    {
+        if (session)
+            replay_close(session);
+        return;
+    }
+
+    if (session == NULL)
+        session = replay_open(key, nick);
+    else if (*nick && session->cptr->status != STAT_CLIENT)
+        stub_register(session->cptr, nick);
+
+    if (len == 4 && !strncmp(cmdline, "PART", 4))
+    {
+        aChannel *chptr = *end ? find_channel(end + 1, NULL) : NULL;
+
+        if (chptr && IsMember(session->cptr, chptr))
+            stub_part(session->cptr, chptr);
+        return;
+    }
+
+    if ((cmd = replay_command(cmdline, len)) == NULL)
+        return;
+
+    bytes = stub_bytes;
+    start = replay_now();
+
+    stub_command(session->cptr, "%s", cmdline);
+
+    replay_record(cmd, replay_now() - start, stub_bytes - bytes);
+    stub_flush(session->cptr);
+}
+
+static char **replay_read(const char *path, unsigned long *count)
+{
+    FILE *fh = fopen(path, "r");
+    char buf[BUFSIZE * 2];
+    char **lines = NULL;
+    unsigned long size = 0;
+
+    *count = 0;
+
+    if (fh == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    while (fgets(buf, sizeof(buf), fh))
+    {
+        if (*count == size)
+        {
+            size = size ? size * 2 : 4096;
+            lines = realloc(lines, size * sizeof(char *));
+        }
+        lines[(*count)++] = strdup(buf);
+    }
+
+    fclose(fh);
+    return lines;
+}
+
+int main(int argc, char **argv)
+{
+    char line[BUFSIZE * 2];
+    char **lines;
+    unsigned long count, i, total = 0;
+    int passes = 1, pass, c;
+    struct rusage usage;
+    uint64_t start, ns, busy = 0;
+
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        if (c == 'n' && atoi(optarg) > 0)
+            passes = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n passes] tracefile\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-n passes] tracefile\n", argv[0]);
+        return 1;
+    }
+
+    lines = replay_read(argv[optind], &count);
+
+    wol_hash_init(&sessions);
+    stub_load();
+
+    /* a recorded storm would otherwise wait for a login tick that never comes */
+    stub_setting("login-rate", "1000000");
+    stub_setting("login-burst", "1000000");
+    stub_setting("login-ip-rate", "100000");
+    stub_setting("login-ip-burst", "100000");
+    stub_setting("test-password", "1");     /* the recorded clients log in with "test" */
+    stub_tick();
+
+    start = replay_now();
+
+    for (pass = 0; pass < passes; pass++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            strcpy(line, lines[i]);
+            replay_line(line);
+        }
+
+        while (nlive)
+            replay_close(live[nlive - 1]);
+    }
+
+    ns = replay_now() - start;
+
+    for (c = 0; c < ncommands; c++)
+    {
+        total += commands[c].calls;
+        for (i = 0; i < commands[c].calls; i++)
+            busy += commands[c].ns[i];
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%lu commands in %.3f s, %.0f commands/sec (%.0f in handlers)\n",
+            total,
+            ns / 1e9,
+            ns ? total * 1e9 / ns : 0.0,
+            busy ? total * 1e9 / busy : 0.0);
+    printf("%lu connections, %lu at peak, peak rss %ld kB, module allocations %lu live %lu\n",
+            created,
+            peak_live,
+            usage.ru_maxrss,
+            stub_allocs,
+            stub_allocs - stub_frees);
+    printf("%-12s %10s %10s %10s %10s %10s\n", "command", "calls", "p50 ns", "p99 ns", "max ns", "bytes/op");
+
+    for (c = 0; c < ncommands; c++)
+    {
+        replay_cmd *cmd = &commands[c];
+
+        if (cmd->calls == 0)
+            continue;
+
+        qsort(cmd->ns, cmd->calls, sizeof(uint64_t), replay_cmp);
+
+        printf("%-12s %10lu %10llu %10llu %10llu %10.1f\n",
+                cmd->name,
+                cmd->calls,
+                (unsigned long long)cmd->ns[(cmd->calls - 1) * 50 / 100],
+                (unsigned long long)cmd->ns[(cmd->calls - 1) * 99 / 100],
+                (unsigned long long)cmd->ns[cmd->calls - 1],
+                (double)cmd->bytes / cmd->calls);
+    }
+
+    stub_unload();
+    wol_hash_free(&sessions);
+
+    return 0;
+}
@@ -0,0 +1,2 @@
+/* see struct.h */
+#include "struct.h"
@@ -0,0 +1,920 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Stub ircd: a single server with local clients only. Sends are formatted
+   like the real thing and appended to the client's sendq counters but never
+   written anywhere unless stub_capture is set.
+*/
+
+#include "stub.h"
+
+#define STUB_HASH       65536
+#define STUB_COMMANDS   64
+#define STUB_HOOKS      8
+
+struct _Event
+{
+    struct _Event       *next;
+    long                every;
+    long                howmany;
+    vFP                 func;
+    void                *data;
+    time_t              last;
+};
+
+typedef struct stub_command_entry
+{
+    char                *name;
+    int                 (*func)();
+    Cmdoverride         *override;
+} stub_command_entry;
+
+extern ModuleHeader Mod_Header;
+extern int Mod_Test(ModuleInfo *modinfo);
+extern int Mod_Init(ModuleInfo *modinfo);
+extern int Mod_Load(int module_load);
+extern int Mod_Unload(int module_unload);
+
+aClient me;
+aClient *local[MAXCONNECTIONS];
+
+unsigned long stub_allocs;
+unsigned long stub_frees;
+unsigned long stub_appends;
+unsigned long long stub_bytes;
+unsigned long stub_server_msgs;
+FILE *stub_capture;
+int stub_fail_alloc;
+
+static Module stub_module = { "m_wol" };
+static ModuleInfo stub_modinfo = { &stub_module };
+static aClient *clients[STUB_HASH];
+static aChannel *channels[STUB_HASH];
+static stub_command_entry commands[STUB_COMMANDS];
+static int (*hooks[MAXHOOKTYPES][STUB_HOOKS])();
+static Event *events;
+static int next_fd = 1;
+
+#define RUN_HOOK(type, ...)                                 \
+    do {                                                    \
+        int _h;                                             \
+        for (_h = 0; _h < STUB_HOOKS && hooks[type][_h]; _h++) \
+            hooks[type][_h](__VA_ARGS__);                   \
+    } while (0)
+
+void *stub_malloc(size_t n)
+{
+    if (stub_fail_alloc)
+        return NULL;
+
+    stub_allocs++;
+    return malloc(n);
+}
+
+void *stub_calloc(size_t n, size_t m)
+{
+    if (stub_fail_alloc)
+        return NULL;
+
+    stub_allocs++;
+    return calloc(n, m);
+}
+
+void *stub_realloc(void *p, size_t n)
+{
+    if (stub_fail_alloc)
+        return NULL;
+
+    stub_allocs++;
+    return realloc(p, n);
+}
+
+void stub_free(void *p)
+{
+    if (p)
+        stub_frees++;
+    free(p);
+}
+
+static unsigned int stub_hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    for (; *name; name++)
+        h = (h ^ (unsigned char)tolower(*name)) * 16777619u;
+
+    return h & (STUB_HASH - 1);
+}
+
+/* sending */
+
+static void stub_append(aClient *to, const char *msg, unsigned int len)
+{
+    if (to == NULL || !MyConnect(to))
+        return;
+
+    to->sendQ.length += len;
+    to->sendM++;
+    stub_appends++;
+    stub_bytes += len;
+
+    if (stub_capture)
+        fprintf(stub_capture, "-> %s %.*s", to->name, (int)len, msg);
+}
+
+static unsigned int stub_format(char *buf, char *pattern, va_list vl)
+{
+    int len = vsnprintf(buf, BUFSIZE, pattern, vl);
+
+    if (len < 0)
+        len = 0;
+    if (len > BUFSIZE - 2)
+        len = BUFSIZE - 2;
+
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    buf[len] = '\0';
+
+    return len;
+}
+
+void sendbufto_one(aClient *to, char *msg, unsigned int quick)
+{
+    unsigned int len = quick;
+
+    if (!quick)
+    {
+        len = strlen(msg);
+        if (!len || msg[len - 1] != '\n')
+        {
+            if (len > 510)
+                len = 510;
+            msg[len++] = '\r';
+            msg[len++] = '\n';
+            msg[len] = '\0';
+        }
+    }
+
+    /* the real one does the same */
+    if (len >= 1024)
+    {
+        fprintf(stderr, "sendbufto_one: len=%u, quick=%u\n", len, quick);
+        abort();
+    }
+
+    stub_append(to, msg, len);
+}
+
+void sendto_one(aClient *to, char *pattern, ...)
+{
+    char buf[BUFSIZE + 1];
+    unsigned int len;
+    va_list vl;
+
+    va_start(vl, pattern);
+    len = stub_format(buf, pattern, vl);
+    va_end(vl);
+
+    stub_append(to, buf, len);
+}
+
+void sendto_prefix_one(aClient *to, aClient *from, char *pattern, ...)
+{
+    char buf[BUFSIZE + 1];
+    unsigned int len;
+    va_list vl;
+
+    va_start(vl, pattern);
+    len = stub_format(buf, pattern, vl);
+    va_end(vl);
+
+    stub_append(to, buf, len);
+}
+
+void sendto_channel_butserv(aChannel *chptr, aClient *from, char *pattern, ...)
+{
+    char buf[BUFSIZE + 1];
+    unsigned int len;
+    Member *cm;
+    va_list vl;
+
+    va_start(vl, pattern);
+    len = stub_format(buf, pattern, vl);
+    va_end(vl);
+
+    for (cm = chptr->members; cm; cm = cm->next)
+        stub_append(cm->cptr, buf, len);
+}
+
+/* there are no links to send to, captured as => servers */
+static void stub_server_msg(char *prefix, char *command, char *pattern, va_list vl)
+{
+    char buf[BUFSIZE + 1];
+
+    stub_server_msgs++;
+
+    if (stub_capture)
+    {
+        stub_format(buf, pattern, vl);
+        fprintf(stub_capture, "=> servers :%s %s %s", prefix, command, buf);
+    }
+}
+
+void sendto_serv_butone_token(aClient *one, char *prefix, char *command, char *token, char *pattern, ...)
+{
+    va_list vl;
+
+    va_start(vl, pattern);
+    stub_server_msg(prefix, command, pattern, vl);
+    va_end(vl);
+}
+
+void sendto_serv_butone_token_opt(aClient *one, int opt, char *prefix, char *command, char *token, char *pattern, ...)
+{
+    va_list vl;
+
+    va_start(vl, pattern);
+    stub_server_msg(prefix, command, pattern, vl);
+    va_end(vl);
+}
+
+void sendto_realops(char *pattern, ...)
+{
+}
+
+void ircd_log(int flags, char *pattern, ...)
+{
+}
+
+void config_error(char *pattern, ...)
+{
+    va_list vl;
+
+    va_start(vl, pattern);
+    vfprintf(stderr, pattern, vl);
+    va_end(vl);
+    fputc('\n', stderr);
+}
+
+char *err_str(int numeric)
+{
+    switch (numeric)
+    {
+        case ERR_NOSUCHNICK:        return ":%s 401 %s %s :No such nick/channel";
+        case ERR_NOSUCHCHANNEL:     return ":%s 403 %s %s :No such channel";
+        case ERR_TOOMANYTARGETS:    return ":%s 407 %s :Duplicate recipients. No message delivered";
+        case ERR_NOTONCHANNEL:      return ":%s 442 %s %s :You're not on that channel";
+        case ERR_NEEDMOREPARAMS:    return ":%s 461 %s %s :Not enough parameters";
+        case ERR_CHANNELISFULL:     return ":%s 471 %s %s :Cannot join channel (+l)";
+        case ERR_INVITEONLYCHAN:    return ":%s 473 %s %s :Cannot join channel (+i)";
+        case ERR_BANNEDFROMCHAN:    return ":%s 474 %s %s :Cannot join channel (+b)";
+        case ERR_BADCHANNELKEY:     return ":%s 475 %s %s :Cannot join channel (+k)";
+        case ERR_NOPRIVILEGES:      return ":%s 481 %s :Permission Denied";
+        case ERR_CHANOPRIVSNEEDED:  return ":%s 482 %s %s :You're not channel operator";
+    }
+
+    return ":%s 999 %s :Unknown error";
+}
+
+char *rpl_str(int numeric)
+{
+    switch (numeric)
+    {
+        case RPL_LISTSTART:         return ":%s 321 %s Channel :Users  Name";
+        case RPL_LISTEND:           return ":%s 323 %s :End of /LIST";
+        case RPL_TOPIC:             return ":%s 332 %s %s :%s";
+        case RPL_USERIP:            return ":%s 340 %s :%s";
+        case RPL_NAMREPLY:          return ":%s 353 %s %s";
+        case RPL_ENDOFNAMES:        return ":%s 366 %s %s :End of /NAMES list.";
+    }
+
+    return ":%s 999 %s :Unknown reply";
+}
+
+/* modules */
+
+static stub_command_entry *stub_find_command(const char *name, int create)
+{
+    int i;
+
+    for (i = 0; i < STUB_COMMANDS && commands[i].name; i++)
+    {
+        if (!strcasecmp(commands[i].name, name))
+            return &commands[i];
+    }
+
+    if (!create || i == STUB_COMMANDS)
+        return NULL;
+
+    commands[i].name = strdup(name);
+    return &commands[i];
+}
+
+void *CommandAdd(Module *module, char *cmd, char *tok, int (*func)(), unsigned char params, int flags)
+{
+    stub_command_entry *entry = stub_find_command(cmd, 1);
+
+    entry->func = func;
+    return entry;
+}
+
+void *HookAddEx(Module *module, int hooktype, int (*func)())
+{
+    int i;
+
+    for (i = 0; i < STUB_HOOKS; i++)
+    {
+        if (hooks[hooktype][i] == NULL)
+        {
+            hooks[hooktype][i] = func;
+            return &hooks[hooktype][i];
+        }
+    }
+
+    return NULL;
+}
+
+Cmdoverride *CmdoverrideAdd(Module *module, char *cmd, int (*func)())
+{
+    stub_command_entry *entry = stub_find_command(cmd, 1);
+
+    entry->override = calloc(1, sizeof(Cmdoverride));
+    entry->override->command = entry->name;
+    entry->override->func = func;
+
+    return entry->override;
+}
+
+void CmdoverrideDel(Cmdoverride *ovr)
+{
+    stub_command_entry *entry = stub_find_command(ovr->command, 0);
+
+    if (entry)
+        entry->override = NULL;
+
+    free(ovr);
+}
+
+/* the stub has no built in commands, overridden ones end up here */
+int CallCmdoverride(Cmdoverride *ovr, aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    stub_command_entry *entry = stub_find_command(ovr->command, 0);
+
+    if (entry && entry->func)
+        return entry->func(cptr, sptr, parc, parv);
+
+    return 0;
+}
+
+Event *EventAddEx(Module *module, char *name, long every, long howmany, vFP func, void *data)
+{
+    Event *event = calloc(1, sizeof(Event));
+
+    event->every = every;
+    event->howmany = howmany;
+    event->func = func;
+    event->data = data;
+    event->last = TStime();
+    event->next = events;
+    events = event;
+
+    return event;
+}
+
+Event *EventDel(Event *event)
+{
+    Event **p;
+
+    for (p = &events; *p; p = &(*p)->next)
+    {
+        if (*p == event)
+        {
+            *p = event->next;
+            free(event);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static TS stub_offset;
+
+TS stub_clock(void)
+{
+    return time(NULL) + stub_offset;
+}
+
+void stub_tick(void)
+{
+    stub_offset++;
+    stub_run_events();
+}
+
+void stub_run_events(void)
+{
+    Event *event, *next;
+    TS now = TStime();
+
+    for (event = events; event; event = next)
+    {
+        next = event->next;
+        if (now - event->last >= event->every)
+        {
+            event->last = now;
+            event->func(event->data);
+        }
+    }
+}
+
+/* clients and channels */
+
+aClient *find_person(char *name, aClient *next)
+{
+    aClient *cptr;
+
+    for (cptr = clients[stub_hash(name)]; cptr; cptr = cptr->next)
+    {
+        if (!strcasecmp(cptr->name, name))
+            return cptr;
+    }
+
+    return NULL;
+}
+
+aChannel *find_channel(char *name, aChannel *chptr)
+{
+    for (chptr = channels[stub_hash(name)]; chptr; chptr = chptr->nextch)
+    {
+        if (!strcasecmp(chptr->chname, name))
+            return chptr;
+    }
+
+    return NULL;
+}
+
+aChannel *get_channel(aClient *cptr, char *name, int flag)
+{
+    aChannel *chptr = find_channel(name, NULL);
+    unsigned int h;
+
+    if (chptr || flag != CREATE)
+        return chptr;
+
+    chptr = calloc(1, sizeof(aChannel) + strlen(name));
+    strcpy(chptr->chname, name);
+    chptr->creationtime = TStime();
+
+    h = stub_hash(name);
+    chptr->nextch = channels[h];
+    channels[h] = chptr;
+
+    RUN_HOOK(HOOKTYPE_CHANNEL_CREATE, cptr, chptr);
+
+    return chptr;
+}
+
+static void stub_destroy_channel(aChannel *chptr)
+{
+    aChannel **p;
+
+    RUN_HOOK(HOOKTYPE_CHANNEL_DESTROY, chptr);
+
+    for (p = &channels[stub_hash(chptr->chname)]; *p; p = &(*p)->nextch)
+    {
+        if (*p == chptr)
+        {
+            *p = chptr->nextch;
+            break;
+        }
+    }
+
+    free(chptr->topic);
+    free(chptr);
+}
+
+void add_user_to_channel(aChannel *chptr, aClient *who, int flags)
+{
+    Member *cm = calloc(1, sizeof(Member));
+    Membership *mb = calloc(1, sizeof(Membership));
+
+    cm->cptr = who;
+    cm->flags = flags;
+    cm->next = chptr->members;
+    chptr->members = cm;
+    chptr->users++;
+
+    mb->chptr = chptr;
+    mb->flags = flags;
+    mb->next = who->user->channel;
+    who->user->channel = mb;
+}
+
+static void stub_remove_user(aChannel *chptr, aClient *who)
+{
+    Member **cm;
+    Membership **mb;
+
+    for (cm = &chptr->members; *cm; cm = &(*cm)->next)
+    {
+        if ((*cm)->cptr == who)
+        {
+            Member *tmp = *cm;
+            *cm = tmp->next;
+            free(tmp);
+            break;
+        }
+    }
+
+    for (mb = &who->user->channel; *mb; mb = &(*mb)->next)
+    {
+        if ((*mb)->chptr == chptr)
+        {
+            Membership *tmp = *mb;
+            *mb = tmp->next;
+            free(tmp);
+            break;
+        }
+    }
+
+    if (--chptr->users <= 0)
+        stub_destroy_channel(chptr);
+}
+
+void remove_user_from_channel(aClient *sptr, aChannel *chptr)
+{
+    stub_remove_user(chptr, sptr);
+}
+
+int sub1_from_channel(aChannel *chptr)
+{
+    if (--chptr->users <= 0)
+    {
+        stub_destroy_channel(chptr);
+        return 1;
+    }
+
+    return 0;
+}
+
+int IsMember(aClient *cptr, aChannel *chptr)
+{
+    Membership *mb;
+
+    if (cptr->user == NULL)
+        return 0;
+
+    for (mb = cptr->user->channel; mb; mb = mb->next)
+    {
+        if (mb->chptr == chptr)
+            return 1;
+    }
+
+    return 0;
+}
+
+int is_chan_op(aClient *cptr, aChannel *chptr)
+{
+    Membership *mb;
+
+    if (cptr->user == NULL)
+        return 0;
+
+    for (mb = cptr->user->channel; mb; mb = mb->next)
+    {
+        if (mb->chptr == chptr)
+            return (mb->flags & CHFL_CHANOP) != 0;
+    }
+
+    return 0;
+}
+
+void del_invite(aClient *cptr, aChannel *chptr)
+{
+}
+
+int hunt_server_token(aClient *cptr, aClient *sptr, char *command, char *token, char *pattern, int server, int parc, char *parv[])
+{
+    return 0;
+}
+
+char *get_client_name(aClient *cptr, int showip)
+{
+    return cptr->name;
+}
+
+int exit_client(aClient *cptr, aClient *sptr, aClient *from, char *comment)
+{
+    aClient **p;
+
+    if (sptr->status == STAT_CLIENT)
+        RUN_HOOK(HOOKTYPE_LOCAL_QUIT, sptr, comment);
+    else
+        RUN_HOOK(HOOKTYPE_UNKUSER_QUIT, sptr, comment);
+
+    while (sptr->user->channel)
+        stub_remove_user(sptr->user->channel->chptr, sptr);
+
+    for (p = &clients[stub_hash(sptr->name)]; *p; p = &(*p)->next)
+    {
+        if (*p == sptr)
+        {
+            *p = sptr->next;
+            break;
+        }
+    }
+
+    if (MyConnect(sptr))
+        local[sptr->fd] = NULL;
+
+    free(sptr->user->ip_str);
+    free(sptr->user->virthost);
+    free(sptr->user);
+    free(sptr);
+
+    /* only the client being parsed stops the parser */
+    return cptr == sptr ? FLUSH_BUFFER : 0;
+}
+
+char *strtoken(char **save, char *str, char *fs)
+{
+    char *pos = str ? str : *save, *tmp;
+
+    while (pos && *pos && strchr(fs, *pos))
+        pos++;
+
+    if (!pos || !*pos)
+        return (*save = NULL);
+
+    tmp = pos;
+    while (*pos && !strchr(fs, *pos))
+        pos++;
+
+    if (*pos)
+        *pos++ = '\0';
+    else
+        pos = NULL;
+
+    *save = pos;
+    return tmp;
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size)
+    {
+        size_t n = (len >= size) ? size - 1 : len;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(dst);
+
+    if (len >= size)
+        return len + strlen(src);
+
+    return len + strlcpy(dst + len, src, size - len);
+}
+
+/* driver */
+
+void stub_load(void)
+{
+    strcpy(me.name, "irc.stub");
+    me.fd = -1;
+    me.status = STAT_CLIENT;
+
+    Mod_Test(&stub_modinfo);
+    Mod_Init(&stub_modinfo);
+    Mod_Load(0);
+}
+
+static void stub_config_file(ConfigEntry *ce, ConfigFile *cf)
+{
+    for (; ce; ce = ce->ce_next)
+    {
+        if (ce->ce_fileptr == NULL)
+            ce->ce_fileptr = cf;
+        stub_config_file(ce->ce_entries, cf);
+    }
+}
+
+int stub_config(ConfigEntry *ce)
+{
+    static ConfigFile cf = { "stub.conf" };
+    int h, errs = 0, ret = 0;
+
+    stub_config_file(ce, &cf);
+
+    for (h = 0; h < STUB_HOOKS && hooks[HOOKTYPE_CONFIGTEST][h]; h++)
+    {
+        if (hooks[HOOKTYPE_CONFIGTEST][h](&cf, ce, CONFIG_MAIN, &errs) < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+        RUN_HOOK(HOOKTYPE_CONFIGRUN, &cf, ce, CONFIG_MAIN);
+
+    return ret;
+}
+
+void stub_rehash(void)
+{
+    RUN_HOOK(HOOKTYPE_REHASH);
+}
+
+void stub_rehash_complete(void)
+{
+    RUN_HOOK(HOOKTYPE_REHASH_COMPLETE);
+}
+
+int stub_setting(char *name, char *value)
+{
+    ConfigEntry setting = { NULL, 0, name, value, NULL, NULL };
+    ConfigEntry wol = { NULL, 0, "wol", NULL, &setting, NULL };
+
+    return stub_config(&wol);
+}
+
+/* the ircd drops everything a module registered when it is unloaded */
+void stub_unload(void)
+{
+    Event *event;
+    int i;
+
+    Mod_Unload(0);
+
+    memset(hooks, 0, sizeof(hooks));
+
+    for (i = 0; i < STUB_COMMANDS && commands[i].name; i++)
+    {
+        commands[i].func = NULL;
+        commands[i].override = NULL;
+    }
+
+    while ((event = events))
+    {
+        events = event->next;
+        free(event);
+    }
+}
+
+aClient *stub_client(const char *nick, const char *ip, int registered)
+{
+    aClient *cptr = calloc(1, sizeof(aClient));
+    unsigned int h;
+
+    strncpy(cptr->name, nick, NICKLEN);
+    cptr->from = cptr;
+    /* lowest free slot after the last one handed out, like accept() would */
+    while (local[next_fd])
+        next_fd = (next_fd + 1) % MAXCONNECTIONS;
+    cptr->fd = next_fd;
+    local[cptr->fd] = cptr;
+    cptr->status = registered ? STAT_CLIENT : STAT_UNKNOWN;
+    cptr->since = TStime();
+    cptr->user = calloc(1, sizeof(anUser));
+    cptr->user->ip_str = strdup(ip);
+    /* +x on connect, the cloak only has to differ from the address */
+    strlcpy(cptr->user->realhost, ip, sizeof(cptr->user->realhost));
+    cptr->user->virthost = malloc(HOSTLEN + 1);
+    snprintf(cptr->user->virthost, HOSTLEN + 1, "%.*s.cloaked", NICKLEN, nick);
+    cptr->umodes |= UMODE_HIDE;
+
+    h = stub_hash(cptr->name);
+    cptr->next = clients[h];
+    clients[h] = cptr;
+
+    return cptr;
+}
+
+/* a server linked to this one, its commands go through stub_command */
+aClient *stub_server(const char *name)
+{
+    aClient *cptr = stub_client(name, "127.0.0.1", 1);
+
+    cptr->status = STAT_SERVER;
+
+    return cptr;
+}
+
+/* the link is done and the ircd has sent its users and channels */
+void stub_link(aClient *cptr)
+{
+    RUN_HOOK(HOOKTYPE_SERVER_CONNECT, cptr);
+    /* the burst would go out here */
+    RUN_HOOK(HOOKTYPE_POST_SERVER_CONNECT, cptr);
+}
+
+/* finishes registration of an unknown client under the given nick */
+void stub_register(aClient *cptr, const char *nick)
+{
+    aClient **p;
+    unsigned int h;
+
+    for (p = &clients[stub_hash(cptr->name)]; *p; p = &(*p)->next)
+    {
+        if (*p == cptr)
+        {
+            *p = cptr->next;
+            break;
+        }
+    }
+
+    strncpy(cptr->name, nick, NICKLEN);
+    cptr->status = STAT_CLIENT;
+
+    h = stub_hash(cptr->name);
+    cptr->next = clients[h];
+    clients[h] = cptr;
+}
+
+/* parses one client line like the ircd would and runs the handler */
+int stub_command(aClient *cptr, const char *fmt, ...)
+{
+    char line[BUFSIZE + 1];
+    char *parv[MAXPARA + 2];
+    char *s = line;
+    int parc = 1;
+    stub_command_entry *entry;
+    va_list vl;
+
+    va_start(vl, fmt);
+    vsnprintf(line, sizeof(line), fmt, vl);
+    va_end(vl);
+
+    parv[0] = cptr->name;
+
+    while (*s && parc <= MAXPARA)
+    {
+        while (*s == ' ')
+            *s++ = '\0';
+
+        if (*s == '\0')
+            break;
+
+        if (*s == ':' && parc > 1)
+        {
+            parv[parc++] = s + 1;
+            break;
+        }
+
+        parv[parc++] = s;
+
+        while (*s && *s != ' ')
+            s++;
+    }
+
+    parv[parc] = NULL;
+
+    if (parc < 2 || (entry = stub_find_command(parv[1], 0)) == NULL)
+        return -1;
+
+    /* parv[1] is the command, the handlers see parv[0] followed by params */
+    memmove(&parv[1], &parv[2], (parc - 1) * sizeof(char *));
+    parc--;
+
+    if (entry->override)
+        return entry->override->func(entry->override, cptr, cptr, parc, parv);
+
+    if (entry->func)
+        return entry->func(cptr, cptr, parc, parv);
+
+    return -1;
+}
+
+void stub_part(aClient *cptr, aChannel *chptr)
+{
+    RUN_HOOK(HOOKTYPE_LOCAL_PART, cptr, cptr, chptr, "");
+    stub_remove_user(chptr, cptr);
+}
+
+void stub_flush(aClient *cptr)
+{
+    unsigned long bytes = cptr->sendB + cptr->sendQ.length;
+
+    cptr->sendK += bytes / 1024;
+    cptr->sendB = bytes % 1024;
+    cptr->sendQ.length = 0;
+}
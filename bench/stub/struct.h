@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Minimal stand-in for the parts of the Unreal3.2 API that m_wol.c uses, just
+   enough to build the module outside of the ircd for benchmarking. Names and
+   layouts follow Unreal where the module touches them, everything else is
+   left out. The other ircd headers m_wol.c includes all pull in this one.
+*/
+
+#ifndef WOL_STUB_STRUCT_H
+#define WOL_STUB_STRUCT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <stdarg.h>
+
+#define DLLFUNC
+#define BUFSIZE         512
+#define NICKLEN         30
+#define USERLEN         10
+#define HOSTLEN         63
+#define KEYLEN          23
+#define TOPICLEN        307
+#define CHANNELLEN      32
+#define MAXPARA         15
+#define MAXCONNECTIONS  65536
+
+#define MOD_SUCCESS     0
+#define MOD_FAILED      -1
+#define FLUSH_BUFFER    -2
+#define MOD_HEADER(name)    Mod_Header
+#define MOD_TEST(name)      Mod_Test
+#define MOD_INIT(name)      Mod_Init
+#define MOD_LOAD(name)      Mod_Load
+#define MOD_UNLOAD(name)    Mod_Unload
+
+#define M_UNREGISTERED  0x0001
+#define M_USER          0x0002
+#define M_SERVER        0x0004
+
+#define HOOKTYPE_LOCAL_QUIT         1
+#define HOOKTYPE_LOCAL_NICKCHANGE   2
+#define HOOKTYPE_SERVER_CONNECT     5
+#define HOOKTYPE_LOCAL_JOIN         8
+#define HOOKTYPE_CONFIGTEST         9
+#define HOOKTYPE_CONFIGRUN          10
+#define HOOKTYPE_LOCAL_PART         13
+#define HOOKTYPE_LOCAL_KICK         14
+#define HOOKTYPE_LOCAL_CHANMODE     15
+#define HOOKTYPE_UNKUSER_QUIT       18
+#define HOOKTYPE_REMOTE_QUIT        21
+#define HOOKTYPE_REMOTE_NICKCHANGE  25
+#define HOOKTYPE_CHANNEL_CREATE     26
+#define HOOKTYPE_CHANNEL_DESTROY    27
+#define HOOKTYPE_REMOTE_CHANMODE    28
+#define HOOKTYPE_TOPIC              31
+#define HOOKTYPE_REHASH             32
+#define HOOKTYPE_REMOTE_JOIN        37
+#define HOOKTYPE_REMOTE_PART        38
+#define HOOKTYPE_REMOTE_KICK        39
+#define HOOKTYPE_REHASH_COMPLETE    47
+#define HOOKTYPE_POST_SERVER_CONNECT 55
+#define MAXHOOKTYPES                100
+
+#define CONFIG_MAIN     1
+
+#define FLAGS_DEADSOCKET    0x0002
+#define FLAGS_KILLED        0x0004
+
+#define LOG_ERROR       0x0001
+
+#define CREATE          1
+#define CHFL_CHANOP     0x0001
+#define CHFL_VOICE      0x0002
+#define CHFL_DEOPPED    0x0004
+#define LEVEL_ON_JOIN   CHFL_CHANOP
+
+#define MODE_PRIVATE    0x0001
+#define MODE_SECRET     0x0002
+
+#define OPT_NOT_SJ3     0x0001
+#define OPT_SJ3         0x0002
+
+#define MSG_JOIN        "JOIN"
+#define TOK_JOIN        "C"
+#define MSG_PART        "PART"
+#define TOK_PART        "D"
+#define MSG_SJOIN       "SJOIN"
+#define TOK_SJOIN       "~"
+#define MSG_NAMES       "NAMES"
+#define TOK_NAMES       "?"
+
+#define RPL_LISTSTART       321
+#define RPL_LISTEND         323
+#define RPL_TOPIC           332
+#define RPL_USERIP          340
+#define RPL_NAMREPLY        353
+#define RPL_ENDOFNAMES      366
+#define ERR_NOSUCHNICK      401
+#define ERR_NOSUCHCHANNEL   403
+#define ERR_TOOMANYTARGETS  407
+#define ERR_NOTONCHANNEL    442
+#define ERR_NEEDMOREPARAMS  461
+#define ERR_CHANNELISFULL   471
+#define ERR_INVITEONLYCHAN  473
+#define ERR_BANNEDFROMCHAN  474
+#define ERR_BADCHANNELKEY   475
+#define ERR_NOPRIVILEGES    481
+#define ERR_CHANOPRIVSNEEDED 482
+
+typedef long TS;
+typedef void (*vFP)(void *);
+
+typedef struct Client aClient;
+typedef struct Channel aChannel;
+typedef struct SMember Member;
+typedef struct SMembership Membership;
+typedef struct User anUser;
+typedef struct Module Module;
+typedef struct _ModuleInfo ModuleInfo;
+typedef struct _Cmdoverride Cmdoverride;
+typedef struct _Event Event;
+typedef struct _configfile ConfigFile;
+typedef struct _configentry ConfigEntry;
+
+typedef struct dbuf
+{
+    unsigned int        length;
+} dbuf;
+
+#define DBufLength(dyn)     ((dyn)->length)
+
+struct User
+{
+    Membership          *channel;
+    char                *ip_str;
+    char                realhost[HOSTLEN + 1];
+    char                *virthost;
+};
+
+struct Client
+{
+    struct Client       *next;          /* nick hash chain */
+    struct Client       *from;
+    anUser              *user;
+    long                flags;
+    long                umodes;
+    TS                  since;
+    int                 fd;
+    int                 status;
+    dbuf                sendQ;
+    long                sendM;
+    long                sendK;
+    unsigned short      sendB;
+    char                name[HOSTLEN + 1];
+};
+
+struct SMember
+{
+    struct SMember      *next;
+    aClient             *cptr;
+    int                 flags;
+};
+
+struct SMembership
+{
+    struct SMembership  *next;
+    aChannel            *chptr;
+    int                 flags;
+};
+
+typedef struct
+{
+    long                mode;
+    int                 limit;
+    char                key[KEYLEN + 1];
+} Mode;
+
+struct Channel
+{
+    struct Channel      *nextch;        /* channel hash chain */
+    Mode                mode;
+    char                *topic;
+    TS                  topic_time;
+    TS                  creationtime;
+    int                 users;
+    Member              *members;
+    char                chname[1];
+};
+
+struct Module
+{
+    char                *name;
+};
+
+struct _ModuleInfo
+{
+    Module              *handle;
+};
+
+typedef struct
+{
+    char                *name;
+    char                *version;
+    char                *description;
+    char                *modversion;
+    void                *modulecheck;
+} ModuleHeader;
+
+struct _configfile
+{
+    char                *cf_filename;
+};
+
+struct _configentry
+{
+    ConfigFile          *ce_fileptr;
+    int                 ce_varlinenum;
+    char                *ce_varname;
+    char                *ce_vardata;
+    ConfigEntry         *ce_entries;
+    ConfigEntry         *ce_next;
+};
+
+struct _Cmdoverride
+{
+    char                *command;
+    int                 (*func)();
+};
+
+#define CMD_FUNC(x)     int (x)(aClient *cptr, aClient *sptr, int parc, char *parv[])
+#define EVENT(x)        void (x)(void *data)
+
+#define STAT_UNKNOWN    -1
+#define STAT_SERVER     0
+#define STAT_CLIENT     1
+#define UMODE_OPER      0x0001
+#define UMODE_INVISIBLE 0x0002
+#define UMODE_NETADMIN  0x0004
+#define UMODE_HIDE      0x0008
+
+#define MyConnect(x)            ((x)->fd >= 0)
+#define MyClient(x)             (MyConnect(x) && (x)->status == STAT_CLIENT)
+#define IsPerson(x)             ((x)->user && (x)->status == STAT_CLIENT)
+#define IsServer(x)             ((x)->status == STAT_SERVER)
+#define IsAnOper(x)             ((x)->umodes & UMODE_OPER)
+#define IsInvisible(x)          ((x)->umodes & UMODE_INVISIBLE)
+#define IsNetAdmin(x)           ((x)->umodes & UMODE_NETADMIN)
+#define IsHidden(x)             ((x)->umodes & UMODE_HIDE)
+#define PubChannel(x)           (!((x)->mode.mode & (MODE_PRIVATE | MODE_SECRET)))
+#define SecretChannel(x)        ((x)->mode.mode & MODE_SECRET)
+#define ShowChannel(v, c)       (PubChannel(c) || IsMember((v), (c)))
+#define OPCanSeeSecret(x)       IsNetAdmin(x)
+#define ChannelExists(n)        (find_channel((n), NULL) != NULL)
+#define GetHost(x)              (IsHidden(x) ? (x)->user->virthost : (x)->user->realhost)
+#define GetIP(x)                (((x)->user && (x)->user->ip_str) ? (x)->user->ip_str : "255.255.255.255")
+#define TStime()                (stub_clock())
+
+#define stricmp                 strcasecmp
+#define strnicmp                strncasecmp
+
+#define FALSE 0
+#define TRUE 1
+
+extern aClient me;
+extern aClient *local[];
+
+/* wall clock unless the driver moves it with stub_tick() */
+extern TS stub_clock(void);
+
+extern void sendto_one(aClient *, char *, ...);
+extern void sendbufto_one(aClient *, char *, unsigned int);
+extern void sendto_realops(char *, ...);
+extern void sendto_channel_butserv(aChannel *, aClient *, char *, ...);
+extern void sendto_prefix_one(aClient *, aClient *, char *, ...);
+extern void sendto_serv_butone_token(aClient *, char *, char *, char *, char *, ...);
+extern void sendto_serv_butone_token_opt(aClient *, int, char *, char *, char *, char *, ...);
+extern void ircd_log(int, char *, ...);
+extern void config_error(char *, ...);
+extern char *err_str(int);
+extern char *rpl_str(int);
+extern void *CommandAdd(Module *, char *, char *, int (*)(), unsigned char, int);
+extern void *HookAddEx(Module *, int, int (*)());
+extern Cmdoverride *CmdoverrideAdd(Module *, char *, int (*)());
+extern void CmdoverrideDel(Cmdoverride *);
+extern int CallCmdoverride(Cmdoverride *, aClient *, aClient *, int, char *[]);
+extern Event *EventAddEx(Module *, char *, long, long, vFP, void *);
+extern Event *EventDel(Event *);
+extern int exit_client(aClient *, aClient *, aClient *, char *);
+extern aChannel *find_channel(char *, aChannel *);
+extern aChannel *get_channel(aClient *, char *, int);
+extern aClient *find_person(char *, aClient *);
+extern void add_user_to_channel(aChannel *, aClient *, int);
+extern void remove_user_from_channel(aClient *, aChannel *);
+extern int sub1_from_channel(aChannel *);
+extern void del_invite(aClient *, aChannel *);
+extern int IsMember(aClient *, aChannel *);
+extern int is_chan_op(aClient *, aChannel *);
+extern int hunt_server_token(aClient *, aClient *, char *, char *, char *, int, int, char *[]);
+extern char *get_client_name(aClient *, int);
+extern char *strtoken(char **, char *, char *);
+extern size_t strlcpy(char *, const char *, size_t);
+extern size_t strlcat(char *, const char *, size_t);
+
+/* the module's own allocations are counted by the benchmark */
+#ifdef WOL_STUB_MODULE
+extern void *stub_malloc(size_t);
+extern void *stub_calloc(size_t, size_t);
+extern void *stub_realloc(void *, size_t);
+extern void stub_free(void *);
+#define malloc(n)               stub_malloc(n)
+#define calloc(n, m)            stub_calloc(n, m)
+#define realloc(p, n)           stub_realloc(p, n)
+#define free(p)                 stub_free(p)
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Driver side of the stub ircd, used by the benchmark tools to create
+   clients, feed them commands and read back what the module did.
+*/
+
+#include "struct.h"
+
+/* counters, never reset by the stub itself */
+extern unsigned long stub_allocs;       /* module malloc/calloc/realloc */
+extern unsigned long stub_frees;
+extern unsigned long stub_appends;      /* sendq appends to clients */
+extern unsigned long long stub_bytes;   /* bytes appended to sendqs */
+extern unsigned long stub_server_msgs;  /* messages to other servers */
+
+/* when set, the module's allocations fail */
+extern int stub_fail_alloc;
+
+/* when set, everything sent to clients is copied here */
+extern FILE *stub_capture;
+
+void stub_load(void);
+void stub_unload(void);
+
+aClient *stub_client(const char *nick, const char *ip, int registered);
+void stub_register(aClient *cptr, const char *nick);
+
+/* a locally linked server, stub_link runs SERVER_CONNECT and POST_SERVER_CONNECT */
+aClient *stub_server(const char *name);
+void stub_link(aClient *cptr);
+int stub_command(aClient *cptr, const char *fmt, ...);
+void stub_part(aClient *cptr, aChannel *chptr);
+void stub_flush(aClient *cptr);
+void stub_run_events(void);
+
+/* moves the clock one second forward and runs the events that are due */
+void stub_tick(void);
+
+/* runs a config block through the test and run hooks, -1 if rejected */
+int stub_config(ConfigEntry *ce);
+
+/* a rehash is stub_rehash, the config again and stub_rehash_complete */
+void stub_rehash(void);
+void stub_rehash_complete(void);
+
+/* sets a single wol { name value; } until the next rehash */
+int stub_setting(char *name, char *value);
@@ -15,11 +15,11 @@
  */
 
 /*
-   This WOL module uses a simple singly linked list to store channels and users
-   with special information that is required in a WOL environment.
+   This WOL module keeps channels and users with special information that is
+   required in a WOL environment in intrusive doubly linked lists.
 
-   It means that when handling a lot of users, it might cause performance
-   problems and needs to use a hash map instead. Just keep that in mind.
+   Lookups by aClient/aChannel go through a pointer keyed hash map next to
+   each list so handlers don't need to walk the whole list on every command.
 */
 
 #include "config.h"
@@ -34,8 +34,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <pthread.h>
 #endif
 #include <fcntl.h>
 #include "h.h"
@@ -48,25 +55,59 @@
 #endif
 
 #include "wol_list.h"
-
-#define dprintf(...) ircd_log(LOG_ERROR, __VA_ARGS__)
+#include "wol_hash.h"
+#include "wol_trace.h"
+#include "wol_stats.h"
+#include "wol_serial.h"
+#include "wol_account.h"
+#include "wol_game.h"
 
 DLLFUNC int wol_cvers(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_cvers(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_apgar(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_apgar(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_serial(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_verchk(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_list(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_list(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_join(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_join(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_joingame(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_joingame(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_userip(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_gameopt(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_gameopt(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 DLLFUNC int wol_startg(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+int _wol_startg(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+DLLFUNC int wol_woltrace(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+DLLFUNC int wol_wolstats(aClient *cptr, aClient *sptr, int parc, char *parv[]);
+DLLFUNC int wol_wolroom(aClient *cptr, aClient *sptr, int parc, char *parv[]);
 
 DLLFUNC int wol_hook_channel_create(aClient *cptr, aChannel *chptr);
 DLLFUNC int wol_hook_channel_destroy(aChannel *chptr);
 DLLFUNC int wol_hook_quit(aClient *cptr, char *comment);
+DLLFUNC int wol_hook_topic(aClient *cptr, aClient *sptr, aChannel *chptr, char *topic);
+DLLFUNC int wol_hook_join(aClient *cptr, aClient *sptr, aChannel *chptr, char *parv[]);
+DLLFUNC int wol_hook_part(aClient *cptr, aClient *sptr, aChannel *chptr, char *comment);
+DLLFUNC int wol_hook_kick(aClient *cptr, aClient *sptr, aClient *who, aChannel *chptr, char *comment);
+DLLFUNC int wol_hook_chanmode(aClient *cptr, aClient *sptr, aChannel *chptr);
+DLLFUNC int wol_hook_local_nickchange(aClient *sptr, char *nick);
+DLLFUNC int wol_hook_remote_nickchange(aClient *cptr, aClient *sptr, char *nick);
+DLLFUNC int wol_hook_server_connect(aClient *cptr);
+
+DLLFUNC int wol_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs);
+DLLFUNC int wol_config_run(ConfigFile *cf, ConfigEntry *ce, int type);
+DLLFUNC int wol_config_rehash();
+DLLFUNC int wol_config_rehash_complete();
+
+DLLFUNC EVENT(wol_gameopt_tick);
+DLLFUNC EVENT(wol_login_tick);
+DLLFUNC EVENT(wol_watch_tick);
+DLLFUNC EVENT(wol_reap_tick);
+DLLFUNC EVENT(wol_sync_tick);
 
 DLLFUNC CMD_FUNC(wol_names);
+CMD_FUNC(_wol_names);
 
 Cmdoverride *_list;
 Cmdoverride *_join;
@@ -82,6 +123,9 @@ int *m_wol = NULL;
 #define MSG_USERIP      "USERIP"
 #define MSG_GAMEOPT     "GAMEOPT"
 #define MSG_STARTG      "STARTG"
+#define MSG_WOLTRACE    "WOLTRACE"
+#define MSG_WOLSTATS    "WOLSTATS"
+#define MSG_WOLROOM     "WOLROOM"
 #define TOK_NONE        NULL
 
 #define RPL_LISTGAME    326
@@ -97,11 +141,87 @@ typedef struct wol_user
 {
     aClient             *p;
     unsigned int        SKU;
-    struct wol_user*    next;
+    char                ip[HOSTLEN + 1];    /* GetIP() at CVERS for STARTG and USERIP */
+    int                 ip_len;
+    unsigned int        ipaddr;             /* the same address as a game's ipaddr */
+    int                 gameopt_tokens;
+    TS                  gameopt_stamp;      /* last token refill */
+    TS                  gameopt_sent;       /* last GAMEOPT relayed at once */
+    int                 watch_type;         /* LIST ... WATCH, 0 if not watching */
+    char                serial[WOL_SERIAL_LEN];     /* key from SERIAL, online */
+    WOL_DLIST_ENTRY(struct wol_user) link;
+    WOL_DLIST_ENTRY(struct wol_user) watch_link;
 } wol_user;
 
+/*
+   GAMEOPT to a channel goes out at once when the sender hasn't had one
+   relayed within the last tick, anything more from the same sender in that
+   tick replaces a single pending payload that the tick event sends. A
+   token bucket per user limits what is relayed at once, over the limit
+   channel updates wait for the tick and private ones are dropped.
+*/
+typedef struct wol_gameopt_entry
+{
+    aClient             *from;
+    TS                  queued;
+    WOL_DLIST_ENTRY(struct wol_gameopt_entry) link;
+    char                payload[BUFSIZE];
+} wol_gameopt_entry;
+
+/*
+   Logins, CVERS and APGAR from a client that isn't a WOL user yet, take a
+   token from a global and a per IP bucket. Over either limit, or while
+   others are already waiting, the command is queued and the client is held
+   in fake lag so the ircd doesn't parse the rest of its input. The login
+   tick replays the queue in order, login-drain clients per second. A full
+   queue turns the client away.
+*/
+#define WOL_LOGIN_ARGS      64
+#define WOL_LOGIN_IPS       1024        /* per IP buckets, direct mapped */
+#define WOL_LOGIN_HOLD      60          /* fake lag while queued */
+
+enum { WOL_LOGIN_CVERS, WOL_LOGIN_APGAR, WOL_LOGIN_CMDS };
+
+typedef struct wol_login
+{
+    aClient             *p;
+    TS                  queued;
+    char                args[WOL_LOGIN_CMDS][WOL_LOGIN_ARGS];   /* empty if not sent */
+    WOL_DLIST_ENTRY(struct wol_login) link;
+} wol_login;
+
+typedef struct wol_login_ip
+{
+    char                ip[HOSTLEN + 1];
+    int                 tokens;
+    TS                  stamp;
+} wol_login_ip;
+
+/*
+   NAMES reply kept rendered per channel as "nick,0,0 " entries packed into
+   chunks that each fill one RPL_NAMREPLY line. Joins append to the last
+   chunk and parts cut the entry out of the chunk the member index points
+   at. Changes the hooks can't patch in place (mode and nick changes, or a
+   member count that no longer matches after a server burst) mark the cache
+   stale and the next NAMES rebuilds it from the member list.
+*/
+#define WOL_NAMES_ENTRY     (NICKLEN + 6)   /* @nick,0,0 and a space */
+
+typedef struct wol_names_chunk
+{
+    int                 len;
+    WOL_DLIST_ENTRY(struct wol_names_chunk) link;
+    char                data[BUFSIZE];
+} wol_names_chunk;
+
+/* what made the channel a WOL channel, plain IRC channels have none */
+#define WOL_CHANNEL_LOBBY   1           /* a WOL user joined it */
+#define WOL_CHANNEL_GAME    2           /* JOINGAME set it up */
+#define WOL_STARTG_MAX      16          /* players in a STARTG, more than any game takes */
+
 typedef struct wol_channel
 {
+    int                 kind;
     int                 type;
     int                 minUsers;
     int                 maxUsers;
@@ -111,581 +231,3772 @@ typedef struct wol_channel
     unsigned int        flags;
     wol_user            *users;
     aChannel            *p;
-    struct wol_channel* next;
+    char                *list_line;     /* cached RPL_LISTGAME after the nick */
+    int                 list_len;       /* 0 when list_line is stale */
+    int                 list_size;
+    int                 list_users;     /* p->users when list_line was made */
+    WOL_DLIST_HEAD(wol_names_chunk) names;
+    wol_hash            names_index;    /* aClient -> wol_names_chunk */
+    int                 names_count;    /* entries in names */
+    int                 names_stale;
+    WOL_DLIST_HEAD(wol_gameopt_entry) gameopts;   /* pending, one per sender */
+    int                 watch_dirty;    /* in the bucket's watch_dirty */
+    TS                  active;         /* last JOINGAME, GAMEOPT or STARTG */
+    TS                  started;        /* STARTG, 0 if not started */
+    TS                  reap_due;       /* in reap_wheel until then, 0 if not */
+    int                 hidden;         /* out of its type bucket, not listed */
+    char                key[KEYLEN + 1];    /* from JOINGAME, empty if none */
+    int                 sync_dirty;     /* in sync_dirty for the other servers */
+    WOL_DLIST_ENTRY(struct wol_channel) link;
+    WOL_DLIST_ENTRY(struct wol_channel) type_link;
+    WOL_DLIST_ENTRY(struct wol_channel) gameopt_link;
+    WOL_DLIST_ENTRY(struct wol_channel) watch_link;
+    WOL_DLIST_ENTRY(struct wol_channel) reap_link;
+    WOL_DLIST_ENTRY(struct wol_channel) sync_link;
 } wol_channel;
 
-static wol_channel *channels = NULL;
-static wol_user *users = NULL;
+static WOL_DLIST_HEAD(wol_channel) channels;
+static WOL_DLIST_HEAD(wol_user) users;
+
+/* game rooms bucketed by type for LIST, types that don't fit share bucket 0 */
+#define WOL_TYPE_BUCKETS    256
+#define WOL_TYPE_INDEX(type)                                \
+    (((type) > 0 && (type) < WOL_TYPE_BUCKETS) ? (type) : 0)
+#define WOL_TYPE_BUCKET(type)                               \
+    channels_by_type[WOL_TYPE_INDEX(type)]
+#define WOL_TYPE_BUCKET_COUNT(type)                         \
+    channels_by_type_count[WOL_TYPE_INDEX(type)]
+
+static WOL_DLIST_HEAD(wol_channel) channels_by_type[WOL_TYPE_BUCKETS];
+static unsigned int channels_by_type_count[WOL_TYPE_BUCKETS];
+
+/*
+   LIST <type> <game> WATCH sends the list like always and keeps the user as
+   a watcher of the type's bucket, until it lists something else, joins a
+   game or quits. Rooms in a watched bucket that change are collected and
+   the watch tick sends their RPL_LISTGAME lines at most once every
+   list-tick seconds. A room that went away is sent as an RPL_LISTGAME line
+   with no users and no settings, which clients already parse.
+*/
+typedef struct wol_watch_gone
+{
+    int                 type;
+    WOL_DLIST_ENTRY(struct wol_watch_gone) link;
+    char                name[CHANNELLEN + 1];
+} wol_watch_gone;
+
+static WOL_DLIST_HEAD(wol_user) watchers[WOL_TYPE_BUCKETS];
+static WOL_DLIST_HEAD(wol_channel) watch_dirty[WOL_TYPE_BUCKETS];
+static WOL_DLIST_HEAD(wol_watch_gone) watch_gone[WOL_TYPE_BUCKETS];
+static unsigned int watch_count;
+static Event *watch_event;
+static TS watch_sent;                   /* last tick that sent anything */
+
+/*
+   Game rooms are timed on a hashed wheel of one second slots. Activity only
+   stamps the room, when its slot comes around a room that has been active
+   since goes back on the wheel further on, so a busy room costs nothing per
+   GAMEOPT. A started room leaves LIST room-started seconds after STARTG and
+   a room nobody touched for room-idle seconds is emptied. wol::room blocks
+   set both per game type.
+*/
+#define WOL_REAP_SLOTS      512         /* power of two, a longer wait takes more turns */
+
+typedef struct wol_room_timeout
+{
+    int                 idle;           /* -1 for the wol::room-idle default */
+    int                 started;
+} wol_room_timeout;
+
+static WOL_DLIST_HEAD(wol_channel) reap_wheel[WOL_REAP_SLOTS];
+static wol_room_timeout room_timeouts[WOL_TYPE_BUCKETS];
+static TS reap_now;                     /* last second the wheel went past */
+static Event *reap_event;
+static unsigned int reap_count;         /* rooms on the wheel */
+
+static unsigned long rooms_reaped;      /* emptied after room-idle */
+
+/* joins turned away before a channel was touched */
+static unsigned long joins_full;
+static unsigned long joins_key;
+static unsigned long joins_started;
+static unsigned long rooms_hidden;      /* out of LIST after room-started */
+
+static unsigned long watch_updates;     /* RPL_LISTGAME lines sent */
+static unsigned long watch_removes;     /* RPL_LISTGAME lines for rooms gone */
+static unsigned long watch_lists;       /* full lists that started a watch */
+
+/*
+   Lobbies come from the config and are grouped by game type like the rooms.
+   The channel is looked up once when it is created so LIST reads the member
+   count the ircd keeps up to date on every join, part, kick and quit.
+*/
+typedef struct wol_lobby
+{
+    char                name[CHANNELLEN + 1];
+    int                 game;
+    aChannel            *p;             /* NULL while nobody is in it */
+    WOL_DLIST_ENTRY(struct wol_lobby) link;
+    WOL_DLIST_ENTRY(struct wol_lobby) game_link;
+} wol_lobby;
+
+static WOL_DLIST_HEAD(wol_lobby) lobbies;
+static WOL_DLIST_HEAD(wol_lobby) lobbies_by_game[WOL_TYPE_BUCKETS];
+
+#define WOL_GAME_LOBBIES(game)                              \
+    lobbies_by_game[WOL_TYPE_INDEX(game)]
+static unsigned int lobby_count;
+
+static wol_pool channel_pool = WOL_POOL_INITIALIZER(wol_channel);
+static wol_pool user_pool = WOL_POOL_INITIALIZER(wol_user);
+static wol_pool gameopt_pool = WOL_POOL_INITIALIZER(wol_gameopt_entry);
+static wol_pool watch_pool = WOL_POOL_INITIALIZER(wol_watch_gone);
+
+/*
+   Game rooms are kept the same on every linked server with WOLROOM. The
+   server a room is made on announces it right after the JOIN so no other
+   server ever sees it as a plain channel. Later changes are collected and
+   the sync tick sends them in as few lines as they fit in, a new link gets
+   every room the same way. An entry is
+
+       +#room,min,max,type,tournament,reserved,ipaddr,flags,started,key
+
+   Nothing is sent for a room that goes away, every server drops the
+   channel itself when the last member leaves and the room with it.
+*/
+#define WOL_SYNC_LINE       (BUFSIZE - HOSTLEN - 16)    /* after ":server WOLROOM :" */
+
+typedef struct wol_sync_batch
+{
+    aClient             *to;            /* NULL for every server */
+    int                 len;
+    char                buf[BUFSIZE];
+} wol_sync_batch;
+
+static WOL_DLIST_HEAD(wol_channel) sync_dirty;
+static Event *sync_event;
+
+static unsigned long sync_lines;        /* WOLROOM lines sent */
+static unsigned long sync_entries;
+static unsigned long sync_bursts;
+static unsigned long sync_applied;      /* rooms from other servers */
+static unsigned long sync_unknown;      /* for channels this server doesn't have */
+
+/* channels with pending GAMEOPTs */
+static WOL_DLIST_HEAD(wol_channel) gameopt_channels;
+static Event *gameopt_event;
+
+static unsigned long gameopt_relayed;   /* sent as they came */
+static unsigned long gameopt_deferred;  /* held for the tick */
+static unsigned long gameopt_coalesced; /* replaced a pending one */
+static unsigned long gameopt_flushed;   /* sent by the tick */
+static unsigned long gameopt_dropped;   /* over the limit, private */
+
+static WOL_DLIST_HEAD(wol_login) logins;
+static wol_hash login_index;            /* aClient -> wol_login */
+static wol_pool login_pool = WOL_POOL_INITIALIZER(wol_login);
+static wol_login_ip login_ips[WOL_LOGIN_IPS];
+static Event *login_event;
+static int login_tokens;
+static TS login_stamp;
+
+static unsigned long login_direct;      /* let through at once */
+static unsigned long login_queued;
+static unsigned long login_refused;     /* queue was full */
+static unsigned long login_replayed;
+static unsigned long login_wait;        /* seconds, all replayed logins */
+static unsigned long login_wait_max;
+
+/*
+   Numeric settings from the wol block, reset to the defaults on rehash.
+*/
+static int gameopt_tick = 1;
+static int gameopt_rate = 10;
+static int gameopt_burst = 20;
+static int snapshot_on_unload = 1;
+static int login_rate = 50;
+static int login_burst = 200;
+static int login_ip_rate = 2;
+static int login_ip_burst = 5;
+static int login_queue = 1000;
+static int login_drain = 50;
+static int list_tick = 1;
+static int room_idle = 1800;
+static int room_started = 60;
+static int game_log_size = 64;
+static int game_log_sync = 5;
+static int test_password = 0;
+
+typedef struct wol_setting
+{
+    char                *name;
+    int                 *value;
+    int                 def;
+    int                 min;
+    int                 max;
+} wol_setting;
+
+static wol_setting wol_settings[] =
+{
+    { "gameopt-tick",   &gameopt_tick,  1,  0,  60 },       /* seconds, 0 relays everything */
+    { "gameopt-rate",   &gameopt_rate,  10, 1,  1000 },     /* per second */
+    { "gameopt-burst",  &gameopt_burst, 20, 1,  1000 },
+    { "snapshot",       &snapshot_on_unload, 1, 0, 1 },     /* 0 kills WOL users on unload */
+    { "login-rate",     &login_rate,    50, 1,  1000000 },  /* per second, all clients */
+    { "login-burst",    &login_burst,   200, 1, 1000000 },
+    { "login-ip-rate",  &login_ip_rate, 2,  1,  100000 },   /* per second, one address */
+    { "login-ip-burst", &login_ip_burst, 5, 1,  100000 },
+    { "login-queue",    &login_queue,   1000, 0, 100000 },  /* 0 turns away what is over */
+    { "login-drain",    &login_drain,   50, 1,  100000 },   /* queued logins per second */
+    { "list-tick",      &list_tick,     1,  1,  60 },       /* seconds between watch updates */
+    { "room-idle",      &room_idle,     1800, 0, 86400 },   /* seconds, 0 keeps idle rooms */
+    { "room-started",   &room_started,  60, 0,  86400 },    /* seconds in LIST after STARTG */
+    { "game-log-size",  &game_log_size, 64, 1,  4096 },     /* MB before the log is rotated */
+    { "game-log-sync",  &game_log_sync, 5,  0,  3600 },     /* seconds between fsyncs, 0 syncs every write */
+    { "test-password",  &test_password, 0,  0,  1 },        /* 1 takes "test" from anyone without wol::accounts */
+    { NULL }
+};
+
+/* aChannel -> wol_channel and aClient -> wol_user */
+static wol_hash channel_index;
+static wol_hash user_index;
+
+/*
+   Banned serials from wol::serials, mapped read only, and the serials in use
+   keyed by their hash so the same key can't be online twice. A rehash keeps
+   the map the same way it keeps the accounts.
+*/
+static const wol_serial_header *serial_db;
+static size_t serial_db_size;
+static int serial_seen;                 /* wol::serials read since the rehash */
+static wol_hash serial_index;           /* wol_serial_hash() | 1 -> wol_user */
+
+static unsigned long serial_checked;
+static unsigned long serial_banned;
+static unsigned long serial_in_use;
+
+/*
+   Accounts from wol::accounts, mapped read only. A rehash keeps the map
+   until the file is read again and only unmaps it once the new one is in
+   place, or when the rehash is done and wol::accounts was taken out.
+*/
+static const wol_account_header *account_db;
+static size_t account_db_size;
+static int account_seen;                /* wol::accounts read since the rehash */
+
+static unsigned long account_ok;
+static unsigned long account_bad;
+static unsigned long account_unknown;
+
+/*
+   Game log from wol::game-log. STARTG packs a record into a byte ring and
+   a writer thread appends whatever is in it to the file, so the ircd never
+   waits for the disk. There is one producer and one consumer, each only
+   moves its own end of the ring. When the ring is full the record is
+   dropped and counted rather than waited on.
+
+   The writer runs until the module is unloaded. A rehash that changes the
+   file or its settings hands them over with the next STARTG, the writer
+   finishes what was queued before and switches, so the ircd never waits
+   for it to drain.
+*/
+#define WOL_GAMELOG_RING    (1 << 20)       /* bytes, power of two */
+#define WOL_GAMELOG_RETRY   60              /* seconds before a writer that failed is tried again */
+
+typedef struct wol_gamelog
+{
+    char                path[512];          /* the writer's copies, it */
+    off_t               max_size;           /* never reads the table */
+    int                 sync;
+    uint8_t             *ring;
+    uint32_t            head;               /* moved by the ircd */
+    uint32_t            tail;               /* moved by the writer */
+    int                 stop;
+    int                 running;
+    time_t              failed;             /* the writer could not be started */
+#ifndef _WIN32
+    pthread_t           thread;
+    pthread_mutex_t     lock;               /* for the next_ fields */
+#endif
+    int                 next;               /* switch to the next_ fields */
+    uint32_t            next_at;            /* once the tail gets here */
+    char                next_path[512];     /* only written by the ircd */
+    off_t               next_max_size;
+    int                 next_sync;
+    unsigned long       queued;             /* counted by the ircd */
+    unsigned long       dropped;
+    unsigned long       written;            /* counted by the writer */
+    unsigned long       syncs;
+    unsigned long       rotations;
+    unsigned long       errors;
+} wol_gamelog;
+
+/* what one side stores before moving its end is seen by the other side
+   once it loads that end */
+#define WOL_ACQUIRE(x)      __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define WOL_RELEASE(x, v)   __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define WOL_COUNT(x, n)     __sync_fetch_and_add(&(x), (n))
+
+static wol_gamelog gamelog;
+static char game_log_path[512];             /* wol::game-log, empty without */
+
+/* channels created on the server while loaded, carried over in the
+   snapshot, for what not tracking the plain ones saves */
+static unsigned int irc_channels;
+static unsigned int channels_by_kind[WOL_CHANNEL_GAME + 1];
 
 wol_channel *wol_get_channel(aChannel *p)
 {
-    wol_channel *channel;
+    return wol_hash_get(&channel_index, p);
+}
+
+wol_user *wol_get_user(aClient *p)
+{
+    return wol_hash_get(&user_index, p);
+}
+
+/* NULL if it could not be allocated or indexed */
+wol_channel *wol_channel_add(aChannel *chptr, int kind)
+{
+    wol_channel *channel = wol_pool_alloc(&channel_pool);
 
-    if (p == NULL)
+    if (channel == NULL)
         return NULL;
 
-    WOL_LIST_FOREACH(channels, channel)
+    if (!wol_hash_put(&channel_index, chptr, channel))
     {
-        if (channel->p == p)
-            return channel;
+        wol_pool_free(&channel_pool, channel);
+        return NULL;
     }
 
-    return NULL;
+    channel->p = chptr;
+    channel->kind = kind;
+    WOL_DLIST_APPEND(channels, channel, link);
+    channels_by_kind[kind]++;
+
+    return channel;
 }
 
-wol_user *wol_get_user(aClient *p)
+/* queues the room for the watchers of its type, if there are any */
+void wol_watch_touch(wol_channel *channel)
 {
-    wol_user *user;
+    int bucket = WOL_TYPE_INDEX(channel->type);
 
-    WOL_LIST_FOREACH(users, user)
+    if (channel->type && !channel->hidden && !channel->watch_dirty && watchers[bucket].first)
     {
-        if (user->p == p)
-            return user;
+        WOL_DLIST_APPEND(watch_dirty[bucket], channel, watch_link);
+        channel->watch_dirty = 1;
     }
-
-    return NULL;
 }
 
-DLLFUNC ModuleHeader MOD_HEADER(m_wol) =
+/* the room leaves its type, watchers get told it is gone */
+void wol_watch_remove(wol_channel *channel)
 {
-    "m_wol",
-    "v1.0",
-    "Westwood Online support", 
-    "3.2-b8-1",
-    NULL 
-};
+    int bucket = WOL_TYPE_INDEX(channel->type);
+    wol_watch_gone *gone;
 
-DLLFUNC int MOD_INIT(m_wol)(ModuleInfo *modinfo)
+    if (channel->watch_dirty)
+    {
+        WOL_DLIST_UNLINK(watch_dirty[bucket], channel, watch_link);
+        channel->watch_dirty = 0;
+    }
+
+    if (channel->type && watchers[bucket].first && (gone = wol_pool_alloc(&watch_pool)))
+    {
+        gone->type = channel->type;
+        strlcpy(gone->name, channel->p->chname, sizeof(gone->name));
+        WOL_DLIST_APPEND(watch_gone[bucket], gone, link);
+    }
+}
+
+void wol_watch_stop(wol_user *user)
 {
-    sendto_realops("m_wol: Loading...");
+    if (user->watch_type)
+    {
+        WOL_DLIST_UNLINK(watchers[WOL_TYPE_INDEX(user->watch_type)], user, watch_link);
+        user->watch_type = 0;
+        watch_count--;
+    }
+}
 
-    CommandAdd(modinfo->handle, MSG_CVERS, TOK_NONE, wol_cvers, MAXPARA, M_UNREGISTERED);
-    CommandAdd(modinfo->handle, MSG_APGAR, TOK_NONE, wol_apgar, MAXPARA, M_UNREGISTERED);
-    CommandAdd(modinfo->handle, MSG_SERIAL, TOK_NONE, wol_serial, MAXPARA, M_UNREGISTERED);
-    CommandAdd(modinfo->handle, MSG_VERCHK, TOK_NONE, wol_verchk, MAXPARA, M_UNREGISTERED);
-    CommandAdd(modinfo->handle, MSG_JOINGAME, TOK_NONE, wol_joingame, MAXPARA, M_USER);
-    CommandAdd(modinfo->handle, MSG_USERIP, TOK_NONE, wol_userip, MAXPARA, M_USER);
-    CommandAdd(modinfo->handle, MSG_GAMEOPT, TOK_NONE, wol_gameopt, MAXPARA, M_USER);
-    CommandAdd(modinfo->handle, MSG_STARTG, TOK_NONE, wol_startg, MAXPARA, M_USER);
+void wol_watch_start(wol_user *user, int type)
+{
+    wol_watch_stop(user);
 
-    HookAddEx(modinfo->handle, HOOKTYPE_CHANNEL_CREATE, wol_hook_channel_create);
-    HookAddEx(modinfo->handle, HOOKTYPE_CHANNEL_DESTROY, wol_hook_channel_destroy);
-    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_QUIT, wol_hook_quit);
+    WOL_DLIST_APPEND(watchers[WOL_TYPE_INDEX(type)], user, watch_link);
+    user->watch_type = type;
+    watch_count++;
+}
 
-    _modinfo = modinfo;
-    return MOD_SUCCESS;
+/* the member count is checked on use so only JOINGAME settings and topic
+   changes need to invalidate the cached LIST line explicitly */
+void wol_channel_invalidate(wol_channel *channel)
+{
+    channel->list_len = 0;
+    wol_watch_touch(channel);
 }
 
-DLLFUNC int MOD_LOAD(m_wol)(int module_load)
+int wol_channel_list_line(wol_channel *channel, char **line)
 {
-    _list = CmdoverrideAdd(_modinfo->handle, MSG_LIST, wol_list);
-    if (_list == NULL)
+    char buf[BUFSIZE];
+    int len;
+
+    if (channel->list_len && channel->list_users == channel->p->users)
     {
-        sendto_realops("m_wol: Failed to override LIST");
-        return MOD_FAILED;
+        *line = channel->list_line;
+        return channel->list_len;
     }
-    _join = CmdoverrideAdd(_modinfo->handle, MSG_JOIN, wol_join);
-    if (_join == NULL)
+
+    len = snprintf(buf, sizeof(buf), "%s %d %d %d %d %u %u %u::%s",
+            channel->p->chname,
+            channel->p->users,
+            channel->maxUsers,
+            channel->type,
+            channel->tournament,
+            channel->reserved,
+            channel->ipaddr,
+            channel->flags,
+            channel->p->topic ? channel->p->topic : "");
+
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+
+    if (len > channel->list_size)
     {
-        sendto_realops("m_wol: Failed to override LIST");
-        return MOD_FAILED;
+        char *tmp = realloc(channel->list_line, len);
+        if (tmp == NULL)
+            return 0;
+        channel->list_line = tmp;
+        channel->list_size = len;
     }
-    return MOD_SUCCESS;
+
+    memcpy(channel->list_line, buf, len);
+    channel->list_len = len;
+    channel->list_users = channel->p->users;
+
+    *line = channel->list_line;
+    return len;
 }
 
-DLLFUNC int MOD_UNLOAD(m_wol)(int module_unload)
+/* room for names in one RPL_NAMREPLY with the margins the reply always had */
+int wol_names_capacity(wol_channel *channel)
 {
-    wol_user *user;
+    int mlen = strlen(me.name) + NICKLEN + 4 + 7;
+    return BUFSIZE - 7 - mlen - (strlen(channel->p->chname) + 4);
+}
 
-    sendto_realops("m_wol: Unloading...");
+void wol_names_clear(wol_channel *channel)
+{
+    WOL_DLIST_FREE(channel->names, link);
+    wol_hash_free(&channel->names_index);
+    channel->names_count = 0;
+}
+
+void wol_names_add(wol_channel *channel, Member *cm)
+{
+    wol_names_chunk *chunk = channel->names.last;
+    char entry[WOL_NAMES_ENTRY + 1];
+    int len;
 
-    /* disconnect all WOL users so they don't "ghost" around */
-    WOL_LIST_FOREACH(users, user)
+    if (channel->names_stale)
+        return;
+
+    len = snprintf(entry, sizeof(entry), "%s%s,0,0 ",
+            (cm->flags & CHFL_CHANOP) ? "@" : (cm->flags & CHFL_VOICE) ? "+" : "",
+            cm->cptr->name);
+
+    if (chunk == NULL || chunk->len + len > wol_names_capacity(channel))
     {
-        if (user->p)
+        if ((chunk = WOL_ALLOC(sizeof(wol_names_chunk))) == NULL)
         {
-            user->p->flags |= FLAGS_KILLED;
-            exit_client(NULL, user->p, &me, "Killed by m_wol");
+            channel->names_stale = 1;
+            return;
         }
+        WOL_DLIST_APPEND(channel->names, chunk, link);
     }
 
-    WOL_LIST_FREE(channels);
-    WOL_LIST_FREE(users);
+    memcpy(chunk->data + chunk->len, entry, len);
+    chunk->len += len;
+    channel->names_count++;
 
-    CmdoverrideDel(_list);
-    CmdoverrideDel(_join);
+    /* a name that can't be found again can't be removed, start over */
+    if (!wol_hash_put(&channel->names_index, cm->cptr, chunk))
+        channel->names_stale = 1;
+}
 
-    return MOD_SUCCESS;
+void wol_names_del(wol_channel *channel, aClient *acptr)
+{
+    wol_names_chunk *chunk;
+    int nlen = strlen(acptr->name);
+    int i = 0, start, name;
+
+    if (channel->names_stale)
+        return;
+
+    if ((chunk = wol_hash_del(&channel->names_index, acptr)) == NULL)
+    {
+        channel->names_stale = 1;
+        return;
+    }
+
+    while (i < chunk->len)
+    {
+        start = name = i;
+        if (chunk->data[name] == '@' || chunk->data[name] == '+')
+            name++;
+
+        while (i < chunk->len && chunk->data[i] != ' ')
+            i++;
+        i++;
+
+        if (i - name == nlen + 5 && !memcmp(chunk->data + name, acptr->name, nlen))
+        {
+            memmove(chunk->data + start, chunk->data + i, chunk->len - i);
+            chunk->len -= i - start;
+            channel->names_count--;
+
+            if (chunk->len == 0)
+            {
+                WOL_DLIST_UNLINK(channel->names, chunk, link);
+                free(chunk);
+            }
+            return;
+        }
+    }
+
+    channel->names_stale = 1;
 }
 
-int _is_numeric(const char *str)
+/* add_user_to_channel() puts the new member first */
+void wol_names_joined(wol_channel *channel, aClient *acptr)
 {
-    int i,len = strlen(str);
-    for (i = 0; i < len; i++)
-        if (!isdigit(str[i]))
-            return 0;
-    return 1;
+    if (channel->p->members && channel->p->members->cptr == acptr)
+        wol_names_add(channel, channel->p->members);
+    else
+        channel->names_stale = 1;
 }
 
-int wol_cvers(aClient *cptr, aClient *sptr, int parc, char *parv[])
+void wol_names_rebuild(wol_channel *channel)
 {
-    dprintf("wol_cvers(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    Member *cm;
 
-    /* this is the first WOL specific message we get from the client and is used
-       to trigger WOL specific behaviour to the client */
+    wol_names_clear(channel);
+    channel->names_stale = 0;
 
-    if (parc < 3)
-    {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "CVERS");
-        return 0;
-    }
+    for (cm = channel->p->members; cm; cm = cm->next)
+        wol_names_add(channel, cm);
+}
 
-    wol_user *user = wol_get_user(sptr);
+/* NULL if it could not be allocated or indexed */
+wol_user *wol_user_add(aClient *sptr)
+{
+    wol_user *user = wol_pool_alloc(&user_pool);
 
     if (user == NULL)
+        return NULL;
+
+    if (!wol_hash_put(&user_index, sptr, user))
     {
-        user = WOL_ALLOC(sizeof(wol_user));
-        user->p = sptr;
-        WOL_LIST_INSERT(users, user);
+        wol_pool_free(&user_pool, user);
+        return NULL;
     }
 
-    user->SKU = atoi(parv[2]);
+    user->p = sptr;
+    user->gameopt_tokens = gameopt_burst;
+    user->gameopt_stamp = TStime();
+    WOL_DLIST_APPEND(users, user, link);
 
-    dprintf(" unk is %08X", atoi(parv[1]));
-    dprintf(" game SKU is %08X", user->SKU);
+    return user;
+}
 
-    return 0;
+/* clients read ipaddr straight into a sockaddr, so it stays in network order
+   and anything that isn't IPv4 is 0 like before */
+void wol_user_set_ip(wol_user *user, const char *ip)
+{
+    unsigned int addr;
+
+    strlcpy(user->ip, ip ? ip : "0.0.0.0", sizeof(user->ip));
+    user->ip_len = strlen(user->ip);
+
+    addr = inet_addr(user->ip);
+    user->ipaddr = addr == INADDR_NONE ? 0 : addr;
 }
 
-int wol_apgar(aClient *cptr, aClient *sptr, int parc, char *parv[])
+/* plain channels have type 0 and are not in any bucket */
+void wol_channel_set_type(wol_channel *channel, int type)
 {
-    dprintf("wol_apgar(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    if (channel->type == type)
+        return;
 
-    if (parc < 3)
+    if (channel->type && !channel->hidden)
     {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "APGAR");
-        return 0;
+        wol_watch_remove(channel);
+        WOL_DLIST_UNLINK(WOL_TYPE_BUCKET(channel->type), channel, type_link);
+        WOL_TYPE_BUCKET_COUNT(channel->type)--;
     }
 
-    wol_user    *user       = wol_get_user(cptr);
+    channel->type = type;
 
-    if (strcmp(parv[1], "0aIraaaa")) /* password is "test" */
+    if (channel->type && !channel->hidden)
     {
-        sendto_one(sptr, ":%s %d %s :Invalid password",
-                me.name,
-                RPL_BADPASS,
-                parv[0]);
-        cptr->flags |= FLAGS_KILLED;
-        if (user)
-        {
-            user->p = NULL;
-        }
-        exit_client(NULL, cptr, &me, "m_wol: Invalid password");
+        WOL_DLIST_APPEND(WOL_TYPE_BUCKET(channel->type), channel, type_link);
+        WOL_TYPE_BUCKET_COUNT(channel->type)++;
+        wol_watch_touch(channel);
     }
-
-    return 0;
 }
 
-int wol_serial(aClient *cptr, aClient *sptr, int parc, char *parv[])
+/*
+   The numeric a join to the room fails with, 0 if it can be joined. Only
+   counters the room already keeps are looked at so a rush on a full room
+   costs the channel lookup and nothing more.
+*/
+int wol_channel_joinable(wol_channel *channel, aChannel *chptr, const char *key)
 {
-    dprintf("wol_serial(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    int numeric = 0;
 
-    /* we don't have a serial database so there is no point of checking it */
+    if (channel->kind != WOL_CHANNEL_GAME)
+        return 0;
 
-    return 0;
+    if (channel->started)
+        numeric = ERR_INVITEONLYCHAN;
+    else if (channel->maxUsers > 0 && chptr->users >= channel->maxUsers)
+        numeric = ERR_CHANNELISFULL;
+    else if (channel->tournament && chptr->users >= 2)
+        numeric = ERR_CHANNELISFULL;        /* tournament games are one on one */
+    else if (*channel->key && (!key || strcmp(channel->key, key)))
+        numeric = ERR_BADCHANNELKEY;
+
+    switch (numeric)
+    {
+        case ERR_INVITEONLYCHAN:    joins_started++; break;
+        case ERR_CHANNELISFULL:     joins_full++; break;
+        case ERR_BADCHANNELKEY:     joins_key++; break;
+    }
+
+    return numeric;
 }
 
-int wol_verchk(aClient *cptr, aClient *sptr, int parc, char *parv[])
+/* the room stays and can be joined, it is just not listed any more */
+void wol_room_hide(wol_channel *channel)
 {
-    dprintf("wol_verchk(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    if (channel->hidden)
+        return;
 
-    if (parc < 3)
+    if (channel->type)
     {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "VERCHK");
-        return 0;
+        wol_watch_remove(channel);
+        WOL_DLIST_UNLINK(WOL_TYPE_BUCKET(channel->type), channel, type_link);
+        WOL_TYPE_BUCKET_COUNT(channel->type)--;
     }
 
-    dprintf(" API version is %08X", atoi(parv[1]));
-    dprintf(" SKU version is %08X", atoi(parv[2]));
-
-    /* ignore version check, we don't *really* care */
+    channel->hidden = 1;
+}
 
-    sendto_one(sptr, ":%s %d %s :none none none 1 %s NONREQ",
-            me.name,
-            RPL_VERNONREQ,
-            parv[0],
-            parv[1]);
+int wol_room_idle(wol_channel *channel)
+{
+    int idle = room_timeouts[WOL_TYPE_INDEX(channel->type)].idle;
+    return idle >= 0 ? idle : room_idle;
+}
 
-    return 0;
+int wol_room_started(wol_channel *channel)
+{
+    int started = room_timeouts[WOL_TYPE_INDEX(channel->type)].started;
+    return started >= 0 ? started : room_started;
 }
 
-int wol_list(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+void wol_room_timeouts_reset(void)
 {
-    dprintf("wol_list(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
     int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
 
-    if (parc == 3)
+    for (i = 0; i < WOL_TYPE_BUCKETS; i++)
+        room_timeouts[i].idle = room_timeouts[i].started = -1;
+}
+
+/* takes the room off the wheel and puts it back for whatever is due first,
+   lobbies are never timed */
+void wol_room_schedule(wol_channel *channel)
+{
+    int idle = wol_room_idle(channel);
+    TS due = idle ? channel->active + idle : 0;
+
+    if (channel->kind != WOL_CHANNEL_GAME)
+        due = 0;
+    else if (channel->started && !channel->hidden
+        && (due == 0 || channel->started + wol_room_started(channel) < due))
     {
-        if (_is_numeric(parv[1]) && _is_numeric(parv[2]))
+        due = channel->started + wol_room_started(channel);
+    }
+
+    if (channel->reap_due)
+    {
+        WOL_DLIST_UNLINK(reap_wheel[channel->reap_due & (WOL_REAP_SLOTS - 1)], channel, reap_link);
+        channel->reap_due = 0;
+        reap_count--;
+    }
+
+    if (due)
+    {
+        if (due <= reap_now)
+            due = reap_now + 1;
+
+        WOL_DLIST_APPEND(reap_wheel[due & (WOL_REAP_SLOTS - 1)], channel, reap_link);
+        channel->reap_due = due;
+        reap_count++;
+    }
+}
+
+/* an earlier slot finds the room and moves it on, nothing to do here */
+void wol_room_touch(wol_channel *channel, TS now)
+{
+    channel->active = now;
+
+    if (channel->reap_due == 0)
+        wol_room_schedule(channel);
+}
+
+/* parts the local members, the channel is gone with the last one */
+void wol_room_empty(wol_channel *channel)
+{
+    aChannel    *chptr  = channel->p;
+    Member      *cm, *next;
+    int         left    = chptr->users;
+
+    WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_INFO, "%s expired after %ds", chptr->chname, wol_room_idle(channel));
+
+    rooms_reaped++;
+    wol_room_hide(channel);
+
+    for (cm = chptr->members; cm && left; cm = next)
+    {
+        next = cm->next;
+
+        if (!MyConnect(cm->cptr))
+            continue;
+
+        sendto_channel_butserv(chptr, cm->cptr, ":%s PART %s :Room expired", cm->cptr->name, chptr->chname);
+        sendto_serv_butone_token(&me, cm->cptr->name, MSG_PART, TOK_PART, "%s :Room expired", chptr->chname);
+        wol_hook_part(cm->cptr, cm->cptr, chptr, "Room expired");
+
+        left--;
+        remove_user_from_channel(cm->cptr, chptr);
+    }
+}
+
+/* nobody can join a game that is running, LIST drops it soon after */
+void wol_room_start(wol_channel *channel)
+{
+    channel->active = channel->started = TStime();
+
+    if (wol_room_started(channel) == 0 && !channel->hidden)
+    {
+        wol_room_hide(channel);
+        rooms_hidden++;
+    }
+
+    wol_room_schedule(channel);
+}
+
+/* the room changed here, the sync tick tells the other servers */
+void wol_sync_touch(wol_channel *channel)
+{
+    if (channel->kind == WOL_CHANNEL_GAME && !channel->sync_dirty)
+    {
+        WOL_DLIST_APPEND(sync_dirty, channel, sync_link);
+        channel->sync_dirty = 1;
+    }
+}
+
+void wol_sync_send(wol_sync_batch *batch)
+{
+    if (batch->len == 0)
+        return;
+
+    batch->buf[batch->len] = '\0';
+
+    if (batch->to)
+        sendto_one(batch->to, ":%s %s :%s", me.name, MSG_WOLROOM, batch->buf);
+    else
+        sendto_serv_butone_token(&me, me.name, MSG_WOLROOM, MSG_WOLROOM, ":%s", batch->buf);
+
+    sync_lines++;
+    batch->len = 0;
+}
+
+void wol_sync_add(wol_sync_batch *batch, const char *entry, int len)
+{
+    if (batch->len && batch->len + 1 + len > WOL_SYNC_LINE)
+        wol_sync_send(batch);
+
+    if (batch->len)
+        batch->buf[batch->len++] = ' ';
+
+    memcpy(batch->buf + batch->len, entry, len);
+    batch->len += len;
+    sync_entries++;
+}
+
+void wol_sync_room(wol_sync_batch *batch, wol_channel *channel)
+{
+    char entry[BUFSIZE];
+    int len;
+
+    len = snprintf(entry, sizeof(entry), "+%s,%d,%d,%d,%d,%u,%u,%u,%d,%s",
+            channel->p->chname,
+            channel->minUsers,
+            channel->maxUsers,
+            channel->type,
+            channel->tournament,
+            channel->reserved,
+            channel->ipaddr,
+            channel->flags,
+            channel->started ? 1 : 0,
+            channel->key);
+
+    if (len < WOL_SYNC_LINE)
+        wol_sync_add(batch, entry, len);
+}
+
+/* JOIN to servers without SJOIN, SJOIN with the op status to the rest */
+void wol_join_propagate(aClient *cptr, aClient *sptr, aChannel *chptr, int flags)
+{
+    sendto_serv_butone_token_opt(cptr, OPT_NOT_SJ3, sptr->name, MSG_JOIN, TOK_JOIN,
+            "%s", chptr->chname);
+    sendto_serv_butone_token_opt(cptr, OPT_SJ3, me.name, MSG_SJOIN, TOK_SJOIN,
+            "%li %s :%s%s ", (long)chptr->creationtime, chptr->chname,
+            (flags & CHFL_CHANOP) ? "@" : "", sptr->name);
+}
+
+/* a room from another server, only for a channel its JOIN already made */
+void wol_sync_apply(char *entry)
+{
+    char *field[10], *p = NULL, *s;
+    aChannel *chptr;
+    wol_channel *channel;
+    int n = 0;
+
+    /* strtoken skips the empty key, the numbers are never empty */
+    for (s = strtoken(&p, entry, ","); s && n < 10; s = strtoken(&p, NULL, ","))
+        field[n++] = s;
+
+    if (n < 9 || (chptr = find_channel(field[0], NULL)) == NULL)
+    {
+        sync_unknown++;
+        return;
+    }
+
+    if ((channel = wol_get_channel(chptr)) == NULL)
+    {
+        if ((channel = wol_channel_add(chptr, WOL_CHANNEL_GAME)) == NULL)
+            return;
+    }
+    else if (channel->kind != WOL_CHANNEL_GAME)
+    {
+        channels_by_kind[channel->kind]--;
+        channel->kind = WOL_CHANNEL_GAME;
+        channels_by_kind[channel->kind]++;
+    }
+
+    channel->minUsers   = atoi(field[1]);
+    channel->maxUsers   = atoi(field[2]);
+    wol_channel_set_type(channel, atoi(field[3]));
+    channel->tournament = atoi(field[4]);
+    channel->reserved   = strtoul(field[5], NULL, 10);
+    channel->ipaddr     = strtoul(field[6], NULL, 10);
+    channel->flags      = strtoul(field[7], NULL, 10);
+    strlcpy(channel->key, n > 9 ? field[9] : "", sizeof(channel->key));
+
+    if (atoi(field[8]) && !channel->started)
+        wol_room_start(channel);
+    else
+        wol_room_touch(channel, TStime());
+
+    wol_channel_invalidate(channel);
+    sync_applied++;
+}
+
+wol_lobby *wol_lobby_find(const char *name)
+{
+    wol_lobby *lobby;
+
+    WOL_DLIST_FOREACH(lobbies, lobby, link)
+    {
+        if (!stricmp(lobby->name, name))
+            return lobby;
+    }
+
+    return NULL;
+}
+
+void wol_lobby_add(const char *name, int game)
+{
+    wol_lobby *lobby = wol_lobby_find(name);
+
+    if (lobby)
+    {
+        WOL_DLIST_UNLINK(WOL_GAME_LOBBIES(lobby->game), lobby, game_link);
+    }
+    else
+    {
+        lobby = WOL_ALLOC(sizeof(wol_lobby));
+        strlcpy(lobby->name, name, sizeof(lobby->name));
+        lobby->p = find_channel(lobby->name, NULL);
+        WOL_DLIST_APPEND(lobbies, lobby, link);
+        lobby_count++;
+    }
+
+    lobby->game = game;
+    WOL_DLIST_APPEND(WOL_GAME_LOBBIES(lobby->game), lobby, game_link);
+}
+
+void wol_lobby_clear(void)
+{
+    WOL_DLIST_FREE(lobbies, link);
+    memset(lobbies_by_game, 0, sizeof(lobbies_by_game));
+    lobby_count = 0;
+}
+
+wol_setting *wol_setting_find(const char *name)
+{
+    wol_setting *setting;
+
+    for (setting = wol_settings; setting->name; setting++)
+    {
+        if (!strcmp(setting->name, name))
+            return setting;
+    }
+
+    return NULL;
+}
+
+void wol_settings_reset(void)
+{
+    wol_setting *setting;
+
+    for (setting = wol_settings; setting->name; setting++)
+        *setting->value = setting->def;
+}
+
+/* refills rate tokens a second up to burst and takes one if there is one */
+int wol_bucket_take(int *tokens, TS *stamp, int rate, int burst, TS now)
+{
+    if (now > *stamp)
+    {
+        long refill = *tokens + (long)(now - *stamp) * rate;
+        *tokens = refill > burst ? burst : refill;
+        *stamp = now;
+    }
+
+    if (*tokens <= 0)
+        return 0;
+
+    (*tokens)--;
+    return 1;
+}
+
+int wol_gameopt_allow(wol_user *user, TS now)
+{
+    return wol_bucket_take(&user->gameopt_tokens, &user->gameopt_stamp, gameopt_rate, gameopt_burst, now);
+}
+
+void wol_gameopt_send(wol_channel *channel, wol_gameopt_entry *opt)
+{
+    sendto_channel_butserv(channel->p, opt->from, ":%s GAMEOPT %s :%s",
+            opt->from->name, channel->p->chname, opt->payload);
+}
+
+void wol_gameopt_release(wol_channel *channel, wol_gameopt_entry *opt)
+{
+    WOL_DLIST_UNLINK(channel->gameopts, opt, link);
+    wol_pool_free(&gameopt_pool, opt);
+
+    if (channel->gameopts.first == NULL)
+        WOL_DLIST_UNLINK(gameopt_channels, channel, gameopt_link);
+}
+
+/* sends what has waited a full tick, everything when all is set */
+void wol_gameopt_flush(wol_channel *channel, TS now, int all)
+{
+    wol_gameopt_entry *opt, *next;
+    wol_user *user;
+
+    WOL_DLIST_FOREACH_SAFE(channel->gameopts, opt, next, link)
+    {
+        if (!all && opt->queued + gameopt_tick > now)
+            continue;
+
+        wol_gameopt_send(channel, opt);
+        gameopt_flushed++;
+
+        if ((user = wol_get_user(opt->from)))
+            user->gameopt_sent = now;
+
+        wol_gameopt_release(channel, opt);
+    }
+}
+
+/* drops what a client that left the channel still had pending */
+void wol_gameopt_forget(wol_channel *channel, aClient *from)
+{
+    wol_gameopt_entry *opt, *next;
+
+    WOL_DLIST_FOREACH_SAFE(channel->gameopts, opt, next, link)
+    {
+        if (from == NULL || opt->from == from)
+            wol_gameopt_release(channel, opt);
+    }
+}
+
+/* a slot whose bucket has refilled is as good as empty and is taken over,
+   otherwise addresses that collide share a bucket */
+wol_login_ip *wol_login_ip_get(const char *ip, TS now)
+{
+    wol_login_ip *slot;
+    unsigned int h = 5381;
+    const char *s;
+
+    for (s = ip; *s; s++)
+        h = h * 33 + (unsigned char)*s;
+
+    slot = &login_ips[h % WOL_LOGIN_IPS];
+
+    if (strcmp(slot->ip, ip)
+        && (!*slot->ip || slot->tokens + (long)(now - slot->stamp) * login_ip_rate >= login_ip_burst))
+    {
+        strlcpy(slot->ip, ip, sizeof(slot->ip));
+        slot->tokens = login_ip_burst;
+        slot->stamp = now;
+    }
+
+    return slot;
+}
+
+/* 1 to run the command now, 0 if it was queued or what exit_client()
+   returned when the client was turned away */
+int wol_login_admit(aClient *cptr, aClient *sptr, int cmd, int parc, char *parv[])
+{
+    wol_login *login = wol_hash_get(&login_index, sptr);
+    TS now = TStime();
+    int i, len = 0;
+
+    if (login == NULL)
+    {
+        wol_login_ip *slot;
+
+        if (wol_get_user(sptr))
+            return 1;
+
+        slot = wol_login_ip_get(GetIP(sptr), now);
+
+        if (logins.first == NULL
+            && wol_bucket_take(&slot->tokens, &slot->stamp, login_ip_rate, login_ip_burst, now)
+            && wol_bucket_take(&login_tokens, &login_stamp, login_rate, login_burst, now))
+        {
+            login_direct++;
+            return 1;
+        }
+
+        if (login_pool.live >= (unsigned int)login_queue
+            || (login = wol_pool_alloc(&login_pool)) == NULL)
+        {
+            WOL_TRACE(WOL_TC_USER, WOL_TRACE_WARN, "%p login queue full, turning away", sptr);
+            login_refused++;
+            sendto_one(sptr, ":%s NOTICE %s :Server busy, try again later", me.name, parv[0]);
+            sptr->flags |= FLAGS_KILLED;
+            return exit_client(cptr, sptr, &me, "m_wol: Server busy");
+        }
+
+        login->p = sptr;
+        login->queued = now;
+        WOL_DLIST_APPEND(logins, login, link);
+        wol_hash_put(&login_index, sptr, login);
+        login_queued++;
+
+        /* the ircd leaves the rest of the input in the recvq until this
+           drops back under ten seconds ahead */
+        sptr->since = now + WOL_LOGIN_HOLD;
+
+        WOL_TRACE(WOL_TC_USER, WOL_TRACE_DEBUG, "%p login queued, %u waiting", sptr, login_pool.live);
+    }
+
+    /* only the latest of each, in the order the client sends them */
+    for (i = 1; i < parc && len < WOL_LOGIN_ARGS; i++)
+        len += snprintf(login->args[cmd] + len, WOL_LOGIN_ARGS - len, i > 1 ? " %s" : "%s", parv[i]);
+
+    return 0;
+}
+
+void wol_login_release(wol_login *login)
+{
+    WOL_DLIST_UNLINK(logins, login, link);
+    wol_hash_del(&login_index, login->p);
+    wol_pool_free(&login_pool, login);
+}
+
+void wol_login_run(wol_login *login, TS now)
+{
+    char args[WOL_LOGIN_CMDS][WOL_LOGIN_ARGS];
+    aClient *sptr = login->p;
+    unsigned long wait = now - login->queued;
+    char *parv[MAXPARA + 1];
+    char *tok, *save;
+    int cmd, parc;
+
+    memcpy(args, login->args, sizeof(args));
+    wol_login_release(login);
+
+    login_replayed++;
+    login_wait += wait;
+    if (wait > login_wait_max)
+        login_wait_max = wait;
+
+    sptr->since = now;
+
+    for (cmd = 0; cmd < WOL_LOGIN_CMDS; cmd++)
+    {
+        if (!*args[cmd])
+            continue;
+
+        parv[0] = sptr->name;
+        parc = 1;
+        for (tok = strtoken(&save, args[cmd], " "); tok && parc < MAXPARA; tok = strtoken(&save, NULL, " "))
+            parv[parc++] = tok;
+        parv[parc] = NULL;
+
+        /* APGAR comes last, it can exit the client */
+        if (cmd == WOL_LOGIN_CVERS)
+            _wol_cvers(sptr, sptr, parc, parv);
+        else
+            _wol_apgar(sptr, sptr, parc, parv);
+    }
+}
+
+/* read only view of a whole file, NULL if it can't be opened or is empty */
+void *wol_map(const char *path, size_t *size)
+{
+    struct stat st;
+    void *map = NULL;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+#ifndef _WIN32
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            map = NULL;
+#else
+        if ((map = malloc(st.st_size)) && read(fd, map, st.st_size) != st.st_size)
+        {
+            free(map);
+            map = NULL;
+        }
+#endif
+        *size = st.st_size;
+    }
+
+    close(fd);
+    return map;
+}
+
+void wol_unmap(const void *map, size_t size)
+{
+    if (map == NULL)
+        return;
+#ifndef _WIN32
+    munmap((void *)map, size);
+#else
+    free((void *)map);
+#endif
+}
+
+/* a mapped and checked serial database, NULL if it isn't one */
+const wol_serial_header *wol_serial_open(const char *path, size_t *size)
+{
+    const wol_serial_header *header = wol_map(path, size);
+
+    if (header && !wol_serial_valid(header, *size))
+    {
+        wol_unmap(header, *size);
+        return NULL;
+    }
+
+    return header;
+}
+
+void wol_serial_close(void)
+{
+    wol_unmap(serial_db, serial_db_size);
+    serial_db = NULL;
+    serial_db_size = 0;
+}
+
+/* a mapped and checked account database, NULL if it isn't one */
+const wol_account_header *wol_account_open(const char *path, size_t *size)
+{
+    const wol_account_header *header = wol_map(path, size);
+
+    if (header && !wol_account_valid(header, *size))
+    {
+        wol_unmap(header, *size);
+        return NULL;
+    }
+
+    return header;
+}
+
+void wol_account_close(void)
+{
+    wol_unmap(account_db, account_db_size);
+    account_db = NULL;
+    account_db_size = 0;
+}
+
+#ifndef _WIN32
+/* moves a log out of the way under the time it was let go */
+int wol_gamelog_rotate(const char *path)
+{
+    char name[sizeof(gamelog.path) + 32];
+    unsigned long now = time(NULL);
+    struct stat st;
+    int i;
+
+    snprintf(name, sizeof(name), "%s.%lu", path, now);
+    for (i = 1; stat(name, &st) == 0; i++)
+        snprintf(name, sizeof(name), "%s.%lu.%d", path, now, i);
+
+    return rename(path, name);
+}
+
+/* every writer starts a file of its own, anything already there was left
+   by an earlier one and is rotated first */
+int wol_gamelog_open(wol_gamelog *log, off_t *size)
+{
+    wol_game_header header = { WOL_GAME_MAGIC, WOL_GAME_VERSION };
+    struct stat st;
+    int fd;
+
+    if (stat(log->path, &st) == 0 && st.st_size > 0)
+    {
+        if (wol_gamelog_rotate(log->path) < 0)
+            return -1;
+        WOL_COUNT(log->rotations, 1);
+    }
+
+    if ((fd = open(log->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600)) < 0)
+        return -1;
+
+    if (write(fd, &header, sizeof(header)) != sizeof(header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    *size = sizeof(header);
+    return fd;
+}
+
+/* the length at the start of a record, which may wrap around the ring */
+uint32_t wol_gamelog_peek(const uint8_t *ring, uint32_t pos)
+{
+    uint32_t len;
+    uint8_t *p = (uint8_t *)&len;
+    int i;
+
+    for (i = 0; i < (int)sizeof(len); i++)
+        p[i] = ring[(pos + i) & (WOL_GAMELOG_RING - 1)];
+
+    return len;
+}
+
+/* appends whole records from the tail up to head in one writev, 1 if it
+   stopped at the size limit and the file needs rotating */
+int wol_gamelog_write(wol_gamelog *log, int fd, uint32_t head, off_t *size)
+{
+    struct iovec iov[2];
+    uint32_t tail = log->tail, end, len, start, bytes;
+    unsigned long records = 0;
+    int n = 1;
+
+    for (end = tail; end != head; end += len, records++)
+    {
+        len = wol_gamelog_peek(log->ring, end);
+        if (*size + (end - tail) + len > log->max_size && *size + (end - tail) > (off_t)sizeof(wol_game_header))
+            break;
+    }
+
+    if ((bytes = end - tail) == 0)
+        return 1;
+
+    start = tail & (WOL_GAMELOG_RING - 1);
+    iov[0].iov_base = log->ring + start;
+    iov[0].iov_len = bytes;
+
+    if (start + bytes > WOL_GAMELOG_RING)
+    {
+        iov[0].iov_len = WOL_GAMELOG_RING - start;
+        iov[1].iov_base = log->ring;
+        iov[1].iov_len = bytes - iov[0].iov_len;
+        n = 2;
+    }
+
+    /* a short write is cut off again so the file stays whole records */
+    if (writev(fd, iov, n) != (ssize_t)bytes)
+    {
+        if (ftruncate(fd, *size) < 0)
+            WOL_COUNT(log->errors, 1);
+        return -1;
+    }
+
+    *size += bytes;
+    WOL_COUNT(log->written, records);
+    WOL_RELEASE(log->tail, end);
+
+    return end != head;
+}
+
+void *wol_gamelog_run(void *arg)
+{
+    wol_gamelog *log = arg;
+    struct timespec nap = { 0, 50000000 };
+    time_t synced = time(NULL);
+    off_t size = 0;
+    uint32_t head;
+    int fd = -1, dirty = 0, stop, next, moved, ret;
+
+    for (;;)
+    {
+        /* everything queued before the rehash went to the old file */
+        if (WOL_ACQUIRE(log->next) && log->tail == log->next_at)
+        {
+            pthread_mutex_lock(&log->lock);
+            moved = strcmp(log->path, log->next_path) != 0;
+            strlcpy(log->path, log->next_path, sizeof(log->path));
+            log->max_size = log->next_max_size;
+            log->sync = log->next_sync;
+            WOL_RELEASE(log->next, 0);
+            pthread_mutex_unlock(&log->lock);
+
+            if (moved && fd >= 0)
+            {
+                if (dirty && fsync(fd) < 0)
+                    WOL_COUNT(log->errors, 1);
+                close(fd);
+                fd = -1;
+                dirty = 0;
+            }
+        }
+
+        stop = WOL_ACQUIRE(log->stop);
+        next = WOL_ACQUIRE(log->next);
+        head = next ? log->next_at : WOL_ACQUIRE(log->head);
+
+        if (log->tail != head)
+        {
+            if (fd < 0 && (fd = wol_gamelog_open(log, &size)) < 0)
+            {
+                WOL_COUNT(log->errors, 1);
+                if (stop)
+                    break;
+                nanosleep(&nap, NULL);
+                continue;
+            }
+
+            if ((ret = wol_gamelog_write(log, fd, head, &size)) < 0)
+            {
+                WOL_COUNT(log->errors, 1);
+                if (stop)
+                    break;
+                nanosleep(&nap, NULL);
+                continue;
+            }
+
+            dirty = 1;
+
+            if (ret > 0)
+            {
+                fsync(fd);
+                WOL_COUNT(log->syncs, 1);
+                close(fd);
+                fd = -1;
+                dirty = 0;
+                synced = time(NULL);
+                continue;
+            }
+        }
+
+        if (dirty && (stop || log->sync == 0 || time(NULL) - synced >= log->sync))
+        {
+            if (fsync(fd) < 0)
+                WOL_COUNT(log->errors, 1);
+            WOL_COUNT(log->syncs, 1);
+            dirty = 0;
+            synced = time(NULL);
+        }
+
+        /* a switch still to make comes round again right away */
+        if (next && log->tail == head)
+            continue;
+
+        if (stop && log->tail == head)
+            break;
+
+        if (log->tail == head)
+            nanosleep(&nap, NULL);
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return NULL;
+}
+#endif
+
+/* the writer starts with the first game so the settings are all read,
+   later games hand it whatever a rehash changed */
+int wol_gamelog_start(void)
+{
+#ifndef _WIN32
+    off_t max_size = (off_t)game_log_size << 20;
+
+    if (gamelog.running)
+    {
+        if (strcmp(gamelog.next_path, game_log_path)
+            || gamelog.next_max_size != max_size || gamelog.next_sync != game_log_sync)
+        {
+            pthread_mutex_lock(&gamelog.lock);
+            if (!gamelog.next)
+                gamelog.next_at = gamelog.head;
+            strlcpy(gamelog.next_path, game_log_path, sizeof(gamelog.next_path));
+            gamelog.next_max_size = max_size;
+            gamelog.next_sync = game_log_sync;
+            WOL_RELEASE(gamelog.next, 1);
+            pthread_mutex_unlock(&gamelog.lock);
+        }
+        return 1;
+    }
+
+    /* one notice per try, not one per game */
+    if (gamelog.failed && TStime() - gamelog.failed < WOL_GAMELOG_RETRY)
+        return 0;
+
+    strlcpy(gamelog.path, game_log_path, sizeof(gamelog.path));
+    strlcpy(gamelog.next_path, game_log_path, sizeof(gamelog.next_path));
+    gamelog.max_size = gamelog.next_max_size = max_size;
+    gamelog.sync = gamelog.next_sync = game_log_sync;
+    gamelog.head = gamelog.tail = 0;
+    gamelog.next = 0;
+    gamelog.stop = 0;
+
+    if ((gamelog.ring == NULL && (gamelog.ring = malloc(WOL_GAMELOG_RING)) == NULL)
+        || pthread_mutex_init(&gamelog.lock, NULL) != 0)
+    {
+        sendto_realops("m_wol: no memory for the game log writer for %s", gamelog.path);
+        gamelog.failed = TStime();
+        WOL_COUNT(gamelog.errors, 1);
+        return 0;
+    }
+
+    if (pthread_create(&gamelog.thread, NULL, wol_gamelog_run, &gamelog) != 0)
+    {
+        sendto_realops("m_wol: could not start the game log writer for %s", gamelog.path);
+        pthread_mutex_destroy(&gamelog.lock);
+        gamelog.failed = TStime();
+        WOL_COUNT(gamelog.errors, 1);
+        return 0;
+    }
+
+    gamelog.failed = 0;
+    gamelog.running = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* waits for the writer to empty the ring, only on unload */
+void wol_gamelog_stop(void)
+{
+#ifndef _WIN32
+    if (gamelog.running)
+    {
+        WOL_RELEASE(gamelog.stop, 1);
+        pthread_join(gamelog.thread, NULL);
+        pthread_mutex_destroy(&gamelog.lock);
+        gamelog.running = 0;
+    }
+#endif
+
+    WOL_FREE(gamelog.ring);
+    gamelog.ring = NULL;
+    gamelog.head = gamelog.tail = 0;
+    gamelog.failed = 0;
+}
+
+/* copies a record into the ring, a full ring drops it */
+int wol_gamelog_push(const uint8_t *rec, uint32_t len)
+{
+    uint32_t head = gamelog.head, tail = WOL_ACQUIRE(gamelog.tail), start, first;
+
+    if (len > WOL_GAMELOG_RING - (head - tail))
+    {
+        gamelog.dropped++;
+        return 0;
+    }
+
+    start = head & (WOL_GAMELOG_RING - 1);
+    first = WOL_GAMELOG_RING - start < len ? WOL_GAMELOG_RING - start : len;
+    memcpy(gamelog.ring + start, rec, first);
+    memcpy(gamelog.ring, rec + first, len - first);
+
+    WOL_RELEASE(gamelog.head, head + len);
+    gamelog.queued++;
+
+    return 1;
+}
+
+/* one record per STARTG with the players that were found in the room */
+void wol_gamelog_startg(aClient *sptr, aChannel *chptr, wol_channel *channel, char **names, const char **ips, int count)
+{
+    static uint8_t buf[WOL_GAME_MAX];
+    wol_game_record *rec = (wol_game_record *)buf;
+    wol_user *user = wol_get_user(sptr);
+    uint8_t *p = buf + sizeof(wol_game_record);
+    int name_len, ip_len, i;
+
+    if (!wol_gamelog_start())
+    {
+        gamelog.dropped++;
+        return;
+    }
+
+    memset(rec, 0, sizeof(wol_game_record));
+    rec->time = TStime();
+    rec->SKU = user ? user->SKU : 0;
+    rec->type = channel ? channel->type : 0;
+    p = wol_game_put(p, chptr->chname, strlen(chptr->chname));
+
+    for (i = 0; i < count && rec->players < 255; i++)
+    {
+        if (ips[i] == NULL)
+            continue;
+
+        name_len = strlen(names[i]);
+        ip_len = strlen(ips[i]);
+        if (p + 2 + name_len + ip_len > buf + sizeof(buf))
+            break;
+
+        p = wol_game_put(p, names[i], name_len);
+        p = wol_game_put(p, ips[i], ip_len);
+        rec->players++;
+    }
+
+    rec->len = p - buf;
+    wol_gamelog_push(buf, rec->len);
+}
+
+#define WOL_SERIAL_INDEX(key)   ((void *)(uintptr_t)(wol_serial_hash(key) | 1))
+
+void wol_serial_offline(wol_user *user)
+{
+    if (*user->serial && wol_hash_get(&serial_index, WOL_SERIAL_INDEX(user->serial)) == user)
+        wol_hash_del(&serial_index, WOL_SERIAL_INDEX(user->serial));
+
+    memset(user->serial, 0, sizeof(user->serial));
+}
+
+/* 0 if someone else is online with the key */
+int wol_serial_online(wol_user *user, const char *key)
+{
+    wol_user *other = wol_hash_get(&serial_index, WOL_SERIAL_INDEX(key));
+
+    if (other && other != user && !memcmp(other->serial, key, WOL_SERIAL_LEN))
+        return 0;
+
+    wol_serial_offline(user);
+    memcpy(user->serial, key, WOL_SERIAL_LEN);
+
+    /* another key with the same hash keeps the slot, this one just isn't
+       checked for doubles */
+    if (other == NULL)
+        wol_hash_put(&serial_index, WOL_SERIAL_INDEX(key), user);
+
+    return 1;
+}
+
+/*
+   Snapshot of the registries, written on unload and read back on load so a
+   module upgrade doesn't disconnect anyone. Users are matched back to their
+   connection by fd, pointer and nick and channels by name. A snapshot older
+   than WOL_SNAPSHOT_MAXAGE is ignored, the connections in it may be gone.
+   The layout is raw structs, a different version number means a different
+   layout and the snapshot is not read.
+*/
+#ifndef WOL_SNAPSHOT
+#define WOL_SNAPSHOT            "m_wol.state"
+#endif
+#define WOL_SNAPSHOT_MAGIC      0x534C4F57      /* WOLS */
+#define WOL_SNAPSHOT_VERSION    5
+#define WOL_SNAPSHOT_MAXAGE     60
+
+typedef struct wol_snapshot_header
+{
+    uint32_t            magic;
+    uint32_t            version;
+    int64_t             written;
+    uint32_t            users;
+    uint32_t            channels;
+    uint32_t            irc_channels;
+} wol_snapshot_header;
+
+/* followed by the nick and ip */
+typedef struct wol_snapshot_user
+{
+    uint64_t            ptr;
+    int32_t             fd;
+    uint32_t            SKU;
+    char                serial[WOL_SERIAL_LEN];
+    uint8_t             nick_len;
+    uint8_t             ip_len;
+} wol_snapshot_user;
+
+/* followed by the name */
+typedef struct wol_snapshot_channel
+{
+    int32_t             kind;
+    int32_t             type;
+    int32_t             minUsers;
+    int32_t             maxUsers;
+    int32_t             tournament;
+    uint32_t            reserved;
+    uint32_t            ipaddr;
+    uint32_t            flags;
+    int64_t             active;
+    int64_t             started;
+    uint8_t             hidden;
+    char                key[KEYLEN + 1];
+    uint8_t             name_len;
+} wol_snapshot_channel;
+
+int wol_snapshot_write(void)
+{
+    FILE *fh = fopen(WOL_SNAPSHOT ".tmp", "wb");
+    wol_snapshot_header header;
+    wol_user *user;
+    wol_channel *channel;
+    int ok = 1;
+
+    if (fh == NULL)
+        return 0;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WOL_SNAPSHOT_MAGIC;
+    header.version = WOL_SNAPSHOT_VERSION;
+    header.written = TStime();
+    header.users = user_index.count;
+    header.channels = channel_index.count;
+    header.irc_channels = irc_channels;
+
+    ok &= fwrite(&header, sizeof(header), 1, fh) == 1;
+
+    WOL_DLIST_FOREACH(users, user, link)
+    {
+        wol_snapshot_user rec;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.ptr = (uintptr_t)user->p;
+        rec.fd = user->p->fd;
+        rec.SKU = user->SKU;
+        rec.nick_len = strlen(user->p->name);
+        rec.ip_len = strlen(user->ip);
+        memcpy(rec.serial, user->serial, sizeof(rec.serial));
+
+        ok &= fwrite(&rec, sizeof(rec), 1, fh) == 1;
+        ok &= fwrite(user->p->name, rec.nick_len, 1, fh) == 1 || !rec.nick_len;
+        ok &= fwrite(user->ip, rec.ip_len, 1, fh) == 1 || !rec.ip_len;
+    }
+
+    WOL_DLIST_FOREACH(channels, channel, link)
+    {
+        wol_snapshot_channel rec;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = channel->kind;
+        rec.type = channel->type;
+        rec.minUsers = channel->minUsers;
+        rec.maxUsers = channel->maxUsers;
+        rec.tournament = channel->tournament;
+        rec.reserved = channel->reserved;
+        rec.ipaddr = channel->ipaddr;
+        rec.flags = channel->flags;
+        rec.active = channel->active;
+        rec.started = channel->started;
+        rec.hidden = channel->hidden;
+        memcpy(rec.key, channel->key, sizeof(rec.key));
+        rec.name_len = strlen(channel->p->chname);
+
+        ok &= fwrite(&rec, sizeof(rec), 1, fh) == 1;
+        ok &= fwrite(channel->p->chname, rec.name_len, 1, fh) == 1;
+    }
+
+    ok &= fclose(fh) == 0;
+
+    if (!ok || rename(WOL_SNAPSHOT ".tmp", WOL_SNAPSHOT) < 0)
+    {
+        WOL_TRACE(WOL_TC_ALL, WOL_TRACE_ERROR, "writing snapshot %s failed", WOL_SNAPSHOT);
+
+        remove(WOL_SNAPSHOT ".tmp");
+        return 0;
+    }
+
+    sendto_realops("m_wol: wrote %u users and %u channels to %s", header.users, header.channels, WOL_SNAPSHOT);
+    return 1;
+}
+
+void wol_snapshot_read(void)
+{
+    FILE *fh = fopen(WOL_SNAPSHOT, "rb");
+    wol_snapshot_header header;
+    unsigned int i, users = 0, channels = 0;
+    char name[BUFSIZE];
+    char ip[HOSTLEN + 1];
+
+    if (fh == NULL)
+        return;
+
+    if (fread(&header, sizeof(header), 1, fh) != 1
+        || header.magic != WOL_SNAPSHOT_MAGIC
+        || header.version != WOL_SNAPSHOT_VERSION
+        || TStime() - header.written > WOL_SNAPSHOT_MAXAGE)
+    {
+        sendto_realops("m_wol: ignoring old or unknown snapshot %s", WOL_SNAPSHOT);
+        header.users = header.channels = 0;
+    }
+    else
+    {
+        irc_channels = header.irc_channels;
+    }
+
+    for (i = 0; i < header.users; i++)
+    {
+        wol_snapshot_user rec;
+        aClient *acptr;
+        wol_user *user;
+
+        if (fread(&rec, sizeof(rec), 1, fh) != 1
+            || (rec.nick_len && fread(name, rec.nick_len, 1, fh) != 1)
+            || rec.ip_len > HOSTLEN
+            || (rec.ip_len && fread(ip, rec.ip_len, 1, fh) != 1))
+        {
+            break;
+        }
+
+        name[rec.nick_len] = '\0';
+        ip[rec.ip_len] = '\0';
+
+        /* the same connection, not just a reused slot or address */
+        if (rec.fd < 0 || rec.fd >= MAXCONNECTIONS || (acptr = local[rec.fd]) == NULL
+            || (uintptr_t)acptr != rec.ptr || strcmp(acptr->name, name) || wol_get_user(acptr))
+        {
+            continue;
+        }
+
+        if ((user = wol_user_add(acptr)) == NULL)
+            continue;
+
+        user->SKU = rec.SKU;
+        wol_user_set_ip(user, ip);
+        if (*rec.serial)
+            wol_serial_online(user, rec.serial);
+        users++;
+    }
+
+    for (i = 0; i < header.channels; i++)
+    {
+        wol_snapshot_channel rec;
+        wol_channel *channel;
+        aChannel *chptr;
+
+        if (fread(&rec, sizeof(rec), 1, fh) != 1
+            || (rec.name_len && fread(name, rec.name_len, 1, fh) != 1))
+        {
+            break;
+        }
+
+        name[rec.name_len] = '\0';
+
+        if ((chptr = find_channel(name, NULL)) == NULL
+            || (rec.kind != WOL_CHANNEL_LOBBY && rec.kind != WOL_CHANNEL_GAME))
+        {
+            continue;
+        }
+
+        if ((channel = wol_get_channel(chptr)) == NULL
+            && (channel = wol_channel_add(chptr, rec.kind)) == NULL)
+        {
+            continue;
+        }
+
+        channel->minUsers = rec.minUsers;
+        channel->maxUsers = rec.maxUsers;
+        channel->tournament = rec.tournament;
+        channel->reserved = rec.reserved;
+        channel->ipaddr = rec.ipaddr;
+        channel->flags = rec.flags;
+        wol_channel_set_type(channel, rec.type);
+        wol_channel_invalidate(channel);
+
+        if (rec.kind == WOL_CHANNEL_GAME)
+        {
+            channel->active = rec.active;
+            channel->started = rec.started;
+            memcpy(channel->key, rec.key, sizeof(channel->key));
+            channel->key[KEYLEN] = '\0';
+            if (rec.hidden)
+                wol_room_hide(channel);
+            wol_room_schedule(channel);
+        }
+
+        channels++;
+    }
+
+    fclose(fh);
+    remove(WOL_SNAPSHOT);
+
+    sendto_realops("m_wol: restored %u/%u users and %u/%u channels from %s",
+            users, header.users, channels, header.channels, WOL_SNAPSHOT);
+}
+
+/*
+   Command statistics, reply bytes are what got queued for the calling client
+   during the call, counting what was already written out of the sendq too.
+*/
+
+unsigned long wol_client_bytes(aClient *cptr)
+{
+    if (!MyConnect(cptr))
+        return 0;
+
+    return (unsigned long)cptr->sendK * 1024 + cptr->sendB + DBufLength(&cptr->sendQ);
+}
+
+#define WOL_STATS_RUN(cmd, client, call)                    \
+    do {                                                    \
+        uint64_t _start = wol_stats_now();                  \
+        unsigned long _bytes = wol_client_bytes(client);    \
+        int _ret = (call);                                  \
+        wol_stats_record(cmd, wol_stats_now() - _start,     \
+            wol_client_bytes(client) - _bytes);             \
+        return _ret;                                        \
+    } while (0)
+
+/*
+   Reply builder, whole lines are collected into one buffer and handed to the
+   client's sendq with a single append instead of one per line. The ircd's
+   sendbufto_one() aborts on 1024 bytes or more, so a batch is a couple of
+   lines and goes out before it would get there.
+*/
+
+#define WOL_REPLY_SIZE      1023
+
+typedef struct wol_reply
+{
+    aClient             *to;
+    int                 len;
+    char                buf[WOL_REPLY_SIZE + 1];
+} wol_reply;
+
+void wol_reply_init(wol_reply *reply, aClient *to)
+{
+    reply->to = to;
+    reply->len = 0;
+}
+
+void wol_reply_flush(wol_reply *reply)
+{
+    if (reply->len)
+    {
+        reply->buf[reply->len] = '\0';
+        sendbufto_one(reply->to, reply->buf, reply->len);
+        reply->len = 0;
+    }
+}
+
+/* appends prefix and data as one line, cut to the IRC line length */
+void wol_reply_line(wol_reply *reply, const char *prefix, int prefix_len, const char *data, int len)
+{
+    if (prefix_len + len > BUFSIZE - 2)
+        len = BUFSIZE - 2 - prefix_len;
+
+    if (reply->len + prefix_len + len + 2 > WOL_REPLY_SIZE)
+        wol_reply_flush(reply);
+
+    memcpy(reply->buf + reply->len, prefix, prefix_len);
+    reply->len += prefix_len;
+    memcpy(reply->buf + reply->len, data, len);
+    reply->len += len;
+    reply->buf[reply->len++] = '\r';
+    reply->buf[reply->len++] = '\n';
+}
+
+void wol_reply_printf(wol_reply *reply, char *pattern, ...)
+{
+    char line[BUFSIZE];
+    va_list vl;
+    int len;
+
+    va_start(vl, pattern);
+    len = vsnprintf(line, sizeof(line), pattern, vl);
+    va_end(vl);
+
+    if (len >= (int)sizeof(line))
+        len = sizeof(line) - 1;
+
+    wol_reply_line(reply, line, len, "", 0);
+}
+
+DLLFUNC ModuleHeader MOD_HEADER(m_wol) =
+{
+    "m_wol",
+    "v1.0",
+    "Westwood Online support", 
+    "3.2-b8-1",
+    NULL 
+};
+
+DLLFUNC int MOD_TEST(m_wol)(ModuleInfo *modinfo)
+{
+    HookAddEx(modinfo->handle, HOOKTYPE_CONFIGTEST, wol_config_test);
+    return MOD_SUCCESS;
+}
+
+DLLFUNC int MOD_INIT(m_wol)(ModuleInfo *modinfo)
+{
+    sendto_realops("m_wol: Loading...");
+
+    CommandAdd(modinfo->handle, MSG_CVERS, TOK_NONE, wol_cvers, MAXPARA, M_UNREGISTERED);
+    CommandAdd(modinfo->handle, MSG_APGAR, TOK_NONE, wol_apgar, MAXPARA, M_UNREGISTERED);
+    CommandAdd(modinfo->handle, MSG_SERIAL, TOK_NONE, wol_serial, MAXPARA, M_UNREGISTERED);
+    CommandAdd(modinfo->handle, MSG_VERCHK, TOK_NONE, wol_verchk, MAXPARA, M_UNREGISTERED);
+    CommandAdd(modinfo->handle, MSG_JOINGAME, TOK_NONE, wol_joingame, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_USERIP, TOK_NONE, wol_userip, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_GAMEOPT, TOK_NONE, wol_gameopt, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_STARTG, TOK_NONE, wol_startg, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_WOLTRACE, TOK_NONE, wol_woltrace, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_WOLSTATS, TOK_NONE, wol_wolstats, MAXPARA, M_USER);
+    CommandAdd(modinfo->handle, MSG_WOLROOM, TOK_NONE, wol_wolroom, MAXPARA, M_SERVER);
+
+    HookAddEx(modinfo->handle, HOOKTYPE_CHANNEL_CREATE, wol_hook_channel_create);
+    HookAddEx(modinfo->handle, HOOKTYPE_CHANNEL_DESTROY, wol_hook_channel_destroy);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_QUIT, wol_hook_quit);
+    HookAddEx(modinfo->handle, HOOKTYPE_UNKUSER_QUIT, wol_hook_quit);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_QUIT, wol_hook_quit);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_JOIN, wol_hook_join);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_JOIN, wol_hook_join);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_PART, wol_hook_part);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_PART, wol_hook_part);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_KICK, wol_hook_kick);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_KICK, wol_hook_kick);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_CHANMODE, wol_hook_chanmode);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_CHANMODE, wol_hook_chanmode);
+    HookAddEx(modinfo->handle, HOOKTYPE_LOCAL_NICKCHANGE, wol_hook_local_nickchange);
+    HookAddEx(modinfo->handle, HOOKTYPE_REMOTE_NICKCHANGE, wol_hook_remote_nickchange);
+    HookAddEx(modinfo->handle, HOOKTYPE_TOPIC, wol_hook_topic);
+    HookAddEx(modinfo->handle, HOOKTYPE_POST_SERVER_CONNECT, wol_hook_server_connect);
+    HookAddEx(modinfo->handle, HOOKTYPE_CONFIGRUN, wol_config_run);
+    HookAddEx(modinfo->handle, HOOKTYPE_REHASH, wol_config_rehash);
+    HookAddEx(modinfo->handle, HOOKTYPE_REHASH_COMPLETE, wol_config_rehash_complete);
+
+    wol_hash_init(&channel_index);
+    wol_hash_init(&user_index);
+    wol_hash_init(&login_index);
+    wol_hash_init(&serial_index);
+    wol_settings_reset();
+    wol_room_timeouts_reset();
+
+    login_tokens = login_burst;
+    login_stamp = TStime();
+    reap_now = TStime();
+
+    gameopt_event = EventAddEx(modinfo->handle, "wol_gameopt", 1, 0, wol_gameopt_tick, NULL);
+    login_event = EventAddEx(modinfo->handle, "wol_login", 1, 0, wol_login_tick, NULL);
+    watch_event = EventAddEx(modinfo->handle, "wol_watch", 1, 0, wol_watch_tick, NULL);
+    reap_event = EventAddEx(modinfo->handle, "wol_reap", 1, 0, wol_reap_tick, NULL);
+    sync_event = EventAddEx(modinfo->handle, "wol_sync", 1, 0, wol_sync_tick, NULL);
+
+    _modinfo = modinfo;
+    return MOD_SUCCESS;
+}
+
+DLLFUNC int MOD_LOAD(m_wol)(int module_load)
+{
+    _list = CmdoverrideAdd(_modinfo->handle, MSG_LIST, wol_list);
+    if (_list == NULL)
+    {
+        sendto_realops("m_wol: Failed to override LIST");
+        return MOD_FAILED;
+    }
+    _join = CmdoverrideAdd(_modinfo->handle, MSG_JOIN, wol_join);
+    if (_join == NULL)
+    {
+        sendto_realops("m_wol: Failed to override LIST");
+        return MOD_FAILED;
+    }
+
+    wol_snapshot_read();
+
+    return MOD_SUCCESS;
+}
+
+DLLFUNC int MOD_UNLOAD(m_wol)(int module_unload)
+{
+    wol_user *user, *next;
+    wol_channel *channel;
+
+    sendto_realops("m_wol: Unloading...");
+    sendto_realops("m_wol: %u/%u users and %u/%u channels live/peak in %u+%u chunks",
+            user_pool.live, user_pool.peak,
+            channel_pool.live, channel_pool.peak,
+            user_pool.nchunks, channel_pool.nchunks);
+
+    /* let the queued logins in so they make it into the snapshot */
+    while (logins.first)
+        wol_login_run(logins.first, TStime());
+
+    /* without a snapshot to come back to, disconnect all WOL users so they
+       don't "ghost" around, exit_client calls wol_hook_quit which unlinks
+       and frees the user */
+    if (!snapshot_on_unload || !wol_snapshot_write())
+    {
+        WOL_DLIST_FOREACH_SAFE(users, user, next, link)
+        {
+            if (user->p)
+            {
+                user->p->flags |= FLAGS_KILLED;
+                exit_client(NULL, user->p, &me, "Killed by m_wol");
+            }
+        }
+    }
+
+    WOL_DLIST_FOREACH(channels, channel, link)
+    {
+        wol_gameopt_flush(channel, TStime(), 1);
+        WOL_FREE(channel->list_line);
+        wol_names_clear(channel);
+    }
+
+    if (gameopt_event)
+    {
+        EventDel(gameopt_event);
+        gameopt_event = NULL;
+    }
+
+    if (login_event)
+    {
+        EventDel(login_event);
+        login_event = NULL;
+    }
+
+    if (watch_event)
+    {
+        EventDel(watch_event);
+        watch_event = NULL;
+    }
+
+    if (reap_event)
+    {
+        EventDel(reap_event);
+        reap_event = NULL;
+    }
+
+    if (sync_event)
+    {
+        EventDel(sync_event);
+        sync_event = NULL;
+    }
+
+    WOL_DLIST_INIT(channels);
+    WOL_DLIST_INIT(users);
+    memset(channels_by_type, 0, sizeof(channels_by_type));
+    memset(channels_by_type_count, 0, sizeof(channels_by_type_count));
+    memset(channels_by_kind, 0, sizeof(channels_by_kind));
+    memset(watchers, 0, sizeof(watchers));
+    memset(watch_dirty, 0, sizeof(watch_dirty));
+    memset(watch_gone, 0, sizeof(watch_gone));
+    watch_count = 0;
+    memset(reap_wheel, 0, sizeof(reap_wheel));
+    reap_count = 0;
+    WOL_DLIST_INIT(sync_dirty);
+    wol_lobby_clear();
+    wol_pool_destroy(&channel_pool);
+    wol_pool_destroy(&user_pool);
+    wol_pool_destroy(&gameopt_pool);
+    wol_pool_destroy(&login_pool);
+    wol_pool_destroy(&watch_pool);
+    WOL_DLIST_INIT(gameopt_channels);
+    wol_hash_free(&channel_index);
+    wol_hash_free(&user_index);
+    wol_hash_free(&login_index);
+    wol_hash_free(&serial_index);
+    wol_serial_close();
+    wol_account_close();
+    wol_gamelog_stop();
+
+    CmdoverrideDel(_list);
+    CmdoverrideDel(_join);
+
+    return MOD_SUCCESS;
+}
+
+int _is_numeric(const char *str)
+{
+    int i,len = strlen(str);
+    for (i = 0; i < len; i++)
+        if (!isdigit(str[i]))
+            return 0;
+    return 1;
+}
+
+int wol_cvers(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    int ret;
+
+    WOL_TRACE_PARV(WOL_TC_USER, MSG_CVERS, sptr, parc, parv);
+
+    if (parc >= 3 && (ret = wol_login_admit(cptr, sptr, WOL_LOGIN_CVERS, parc, parv)) <= 0)
+        return ret;
+
+    return _wol_cvers(cptr, sptr, parc, parv);
+}
+
+int _wol_cvers(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    /* this is the first WOL specific message we get from the client and is used
+       to trigger WOL specific behaviour to the client */
+
+    if (parc < 3)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "CVERS");
+        return 0;
+    }
+
+    wol_user *user = wol_get_user(sptr);
+
+    if (user == NULL && (user = wol_user_add(sptr)) == NULL)
+    {
+        WOL_TRACE(WOL_TC_USER, WOL_TRACE_ERROR, "%p out of memory at CVERS", sptr);
+        return 0;
+    }
+
+    user->SKU = atoi(parv[2]);
+    wol_user_set_ip(user, GetIP(sptr));
+
+    WOL_TRACE(WOL_TC_USER, WOL_TRACE_DEBUG, "%p unk is %08X, game SKU is %08X", sptr, atoi(parv[1]), user->SKU);
+
+    return 0;
+}
+
+int wol_apgar(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    int ret;
+
+    WOL_TRACE_PARV(WOL_TC_USER, MSG_APGAR, sptr, parc, parv);
+
+    if (parc >= 3 && (ret = wol_login_admit(cptr, sptr, WOL_LOGIN_APGAR, parc, parv)) <= 0)
+        return ret;
+
+    return _wol_apgar(cptr, sptr, parc, parv);
+}
+
+int _wol_apgar(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    const wol_account *account = NULL;
+    char key[WOL_ACCOUNT_NICKLEN];
+    int ok;
+
+    if (parc < 3)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "APGAR");
+        return 0;
+    }
+
+    if (account_db == NULL)
+    {
+        /* no accounts, only "test" and only when asked for */
+        if (!(ok = test_password && !strcmp(parv[1], "0aIraaaa")))
+            account_unknown++;
+    }
+    else if (wol_account_key(key, sptr->name) == 0
+            || (account = wol_account_find(account_db, key)) == NULL)
+    {
+        account_unknown++;
+        ok = 0;
+    }
+    else if (strlen(parv[1]) != WOL_ACCOUNT_APGAR || memcmp(account->apgar, parv[1], WOL_ACCOUNT_APGAR))
+    {
+        account_bad++;
+        ok = 0;
+    }
+    else
+    {
+        account_ok++;
+        ok = 1;
+    }
+
+    if (!ok)
+    {
+        sendto_one(sptr, ":%s %d %s :Invalid password",
+                me.name,
+                RPL_BADPASS,
+                parv[0]);
+        sptr->flags |= FLAGS_KILLED;
+        /* the quit hooks drop the wol_user, registered or not */
+        return exit_client(cptr, sptr, &me, "m_wol: Invalid password");
+    }
+
+    return 0;
+}
+
+int wol_serial(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    wol_user *user = wol_get_user(sptr);
+    char key[WOL_SERIAL_LEN];
+    char *reason = NULL;
+
+    WOL_TRACE_PARV(WOL_TC_USER, MSG_SERIAL, sptr, parc, parv);
+
+    if (parc < 2 || wol_serial_key(key, parv[1]) == 0)
+        return 0;
+
+    serial_checked++;
+
+    if (serial_db && wol_serial_find(serial_db, key))
+    {
+        serial_banned++;
+        reason = "Serial is banned";
+    }
+    else if (user && !wol_serial_online(user, key))
+    {
+        serial_in_use++;
+        reason = "Serial is already in use";
+    }
+
+    if (reason)
+    {
+        WOL_TRACE(WOL_TC_USER, WOL_TRACE_INFO, "%p %s", sptr, reason);
+        sendto_one(sptr, ":%s NOTICE %s :%s", me.name, parv[0], reason);
+        sptr->flags |= FLAGS_KILLED;
+        return exit_client(cptr, sptr, &me, reason);
+    }
+
+    return 0;
+}
+
+int wol_verchk(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_USER, MSG_VERCHK, sptr, parc, parv);
+
+    if (parc < 3)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "VERCHK");
+        return 0;
+    }
+
+    WOL_TRACE(WOL_TC_USER, WOL_TRACE_DEBUG, "%p API version is %08X, SKU version is %08X", sptr, atoi(parv[1]), atoi(parv[2]));
+
+    /* ignore version check, we don't *really* care */
+
+    sendto_one(sptr, ":%s %d %s :none none none 1 %s NONREQ",
+            me.name,
+            RPL_VERNONREQ,
+            parv[0],
+            parv[1]);
+
+    return 0;
+}
+
+int wol_list(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_STATS_RUN(WOL_STAT_LIST, sptr, _wol_list(anoverride, cptr, sptr, parc, parv));
+}
+
+int _wol_list(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_LIST, MSG_LIST, sptr, parc, parv);
+
+    if (parc == 3 || (parc == 4 && !stricmp(parv[3], "WATCH")))
+    {
+        if (_is_numeric(parv[1]) && _is_numeric(parv[2]))
+        {
+            int list_type = atoi(parv[1]);
+            int game_type = atoi(parv[2]);
+            wol_user *user = wol_get_user(sptr);
+
+            wol_reply reply;
+
+            WOL_TRACE(WOL_TC_LIST, WOL_TRACE_DEBUG, "%p detected WOL LIST, returning custom list", sptr);
+
+            /* any other list ends a watch */
+            if (user && list_type && parc == 4)
+            {
+                wol_watch_start(user, list_type);
+                watch_lists++;
+            }
+            else if (user)
+            {
+                wol_watch_stop(user);
+            }
+
+            wol_reply_init(&reply, sptr);
+            wol_reply_printf(&reply, rpl_str(RPL_LISTSTART), me.name, parv[0]);
+
+            /* list specific game type rooms, only the bucket for the type is
+               walked but the shared overflow bucket still needs the compare */
+            if (list_type)
+            {
+                wol_channel *channel;
+                char prefix[BUFSIZE];
+                char *cached;
+                int prefix_len, len;
+
+                /* the prefix is the same for every room, the rest is cached */
+                prefix_len = snprintf(prefix, sizeof(prefix), ":%s %d %s ", me.name, RPL_LISTGAME, parv[0]);
+
+                WOL_DLIST_FOREACH(WOL_TYPE_BUCKET(list_type), channel, type_link)
+                {
+                    if (channel->type == list_type)
+                    {
+                        len = wol_channel_list_line(channel, &cached);
+                        wol_reply_line(&reply, prefix, prefix_len, cached, len);
+                    }
+                }
+            }
+            else
+            {
+                wol_lobby *lobby;
+                int found = 0;
+
+                /* the game the client logged in with wins over what it asks */
+                if (user && (user->SKU >> 8))
+                    game_type = user->SKU >> 8;
+
+                WOL_DLIST_FOREACH(WOL_GAME_LOBBIES(game_type), lobby, game_link)
+                {
+                    if (lobby->game == game_type)
+                    {
+                        wol_reply_printf(&reply, ":%s %d %s %s %d %d %d", me.name, RPL_LISTLOBBY, parv[0],
+                                lobby->name, lobby->p ? lobby->p->users : 0, 0, 0);
+                        found++;
+                    }
+                }
+
+                /* without a wol::lobby for the game there is a single lobby */
+                if (!found)
+                {
+                    char name[CHANNELLEN + 1];
+                    aChannel *chptr;
+
+                    snprintf(name, sizeof(name), "#Lob_%d_0", game_type);
+                    chptr = find_channel(name, NULL);
+
+                    wol_reply_printf(&reply, ":%s %d %s %s %d %d %d", me.name, RPL_LISTLOBBY, parv[0],
+                            name, chptr ? chptr->users : 0, 0, 0);
+                }
+            }
+
+            wol_reply_printf(&reply, rpl_str(RPL_LISTEND), me.name, parv[0]);
+            wol_reply_flush(&reply);
+            return 0;
+        }
+    }
+
+    return CallCmdoverride(_list, cptr, sptr, parc, parv);
+}
+
+int wol_join(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_STATS_RUN(WOL_STAT_JOIN, sptr, _wol_join(anoverride, cptr, sptr, parc, parv));
+}
+
+int _wol_join(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_CHAN, MSG_JOIN, sptr, parc, parv);
+
+    wol_user    *user       = wol_get_user(cptr);
+    aChannel    *chptr      = find_channel(parv[1], NULL);
+    wol_channel *channel    = wol_get_channel(chptr);
+    int         numeric;
+
+    if (user)
+    {
+        if (chptr && IsMember(sptr, chptr))
+            return 0;
+
+        /* a game room joined with JOIN gets the same checks as JOINGAME */
+        if (channel && (numeric = wol_channel_joinable(channel, chptr, parc > 2 ? parv[2] : NULL)))
+        {
+            sendto_one(sptr, err_str(numeric), me.name, parv[0], chptr->chname);
+            return 0;
+        }
+
+        chptr = get_channel(sptr, parv[1], CREATE);
+
+        WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "%p detected WOL JOIN, returning custom reply", sptr);
+
+        /* the first WOL user in makes it a WOL channel */
+        if (!channel && (channel = wol_channel_add(chptr, WOL_CHANNEL_LOBBY)) == NULL)
+        {
+            WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_ERROR, "%p out of memory joining %s", sptr, chptr->chname);
+            if (!chptr->users)
+                sub1_from_channel(chptr);
+            return 0;
+        }
+
+        WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "%p chptr=%p, channel=%p", sptr, chptr, channel);
+
+        if (channel)
+        {
+            add_user_to_channel(chptr, sptr, 0);
+            wol_names_joined(channel, sptr);
+            wol_watch_touch(channel);
+
+            sendto_channel_butserv(chptr, sptr,
+                ":%s JOIN :0,0 %s", sptr->name, chptr->chname);
+            
+            wol_join_propagate(cptr, sptr, chptr, 0);
+
+            if (MyClient(sptr))
+            {
+                del_invite(sptr, chptr);
+                if (chptr->topic)
+                {
+                    sendto_one(sptr, rpl_str(RPL_TOPIC),
+                        me.name, sptr->name, chptr->chname, chptr->topic);
+                }
+                wol_names(cptr, sptr, 2, parv);
+            }
+        }
+        return 0;
+    }
+    else if (channel)
+    {
+        /* deny access from normal IRC users as their clients would only get messed up */
+        sendto_one(sptr, err_str(ERR_BANNEDFROMCHAN), me.name, parv[0], parv[1]);
+        return 0;
+    }
+
+    /* if call was forwarded from joingame, don't */
+    if (anoverride == NULL)
+    {
+        return 0;
+    }
+
+    return CallCmdoverride(_join, cptr, sptr, parc, parv);
+}
+
+int wol_joingame(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_STATS_RUN(WOL_STAT_JOINGAME, sptr, _wol_joingame(cptr, sptr, parc, parv));
+}
+
+int _wol_joingame(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_CHAN, MSG_JOINGAME, sptr, parc, parv);
+
+    if (parc != 3 && parc != 4 && parc != 9 && parc != 10)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
+        return 0;
+    }
+
+    aChannel    *chptr      = find_channel(parv[1], NULL);
+    wol_channel *channel    = wol_get_channel(chptr);
+    char        *key        = (parc == 4) ? parv[3] : (parc == 10) ? parv[9] : NULL;
+    int         flags, numeric;
+
+    /* handle buggy JOIN from RA, unless it is a key to a game room */
+    if (parc == 4 && !(channel && channel->kind == WOL_CHANNEL_GAME))
+    {
+        return wol_join(NULL, cptr, sptr, parc, parv);
+    }
+
+    /* everything that can fail is checked before a channel is made */
+    if (!chptr && parc < 9)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
+        return 0;
+    }
+
+    /* only WOL channels are tracked, this one was made with a plain JOIN */
+    if (chptr && !channel)
+    {
+        WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "%p JOINGAME %s is not a game room", sptr, chptr->chname);
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
+        return 0;
+    }
+
+    if (chptr)
+    {
+        if (IsMember(sptr, chptr))
+            return 0;
+
+        if ((numeric = wol_channel_joinable(channel, chptr, key)))
+        {
+            sendto_one(sptr, err_str(numeric), me.name, parv[0], chptr->chname);
+            return 0;
+        }
+
+        flags = CHFL_DEOPPED;
+    }
+    else
+    {
+        chptr = get_channel(sptr, parv[1], CREATE);
+        if ((channel = wol_channel_add(chptr, WOL_CHANNEL_GAME)) == NULL)
+        {
+            WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_ERROR, "%p out of memory creating %s", sptr, chptr->chname);
+            sub1_from_channel(chptr);
+            return 0;
+        }
+        flags = LEVEL_ON_JOIN;
+    }
+
+    WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "%p chptr=%p, channel=%p", sptr, chptr, channel);
+
+    if (channel)
+    {
+        wol_user *user = wol_get_user(sptr);
+
+        if (flags == LEVEL_ON_JOIN)
+        {
+            /* read in the WOL channel settings from parv */
+            channel->minUsers   = atoi(parv[2]);
+            channel->maxUsers   = atoi(parv[3]);
+            wol_channel_set_type(channel, atoi(parv[4]));
+            channel->tournament = atoi(parv[7]);
+            channel->reserved   = atoi(parv[8]);
+            if (key)
+                strlcpy(channel->key, key, sizeof(channel->key));
+            channel->ipaddr     = user ? user->ipaddr : 0;
+            wol_channel_invalidate(channel);
+        }
+
+        add_user_to_channel(chptr, sptr, flags);
+        wol_names_joined(channel, sptr);
+        wol_watch_touch(channel);
+        wol_room_touch(channel, TStime());
+
+        /* the new room goes out right behind its JOIN */
+        wol_join_propagate(cptr, sptr, chptr, flags);
+        if (flags == LEVEL_ON_JOIN)
+        {
+            wol_sync_batch batch = { NULL, 0 };
+
+            wol_sync_room(&batch, channel);
+            wol_sync_send(&batch);
+        }
+
+        /* the room list is off the screen in a game room */
+        if (user)
+            wol_watch_stop(user);
+
+        sendto_channel_butserv(chptr, sptr,
+            ":%s JOINGAME %d %d %d %d %u %u %u :%s",
+            sptr->name,
+            channel->minUsers,
+            channel->maxUsers,
+            channel->type,
+            channel->tournament,
+            0, /* unk */
+            channel->ipaddr,
+            channel->flags,
+            chptr->chname);
+        
+        if (MyClient(sptr))
+        {
+            del_invite(sptr, chptr);
+            if (chptr->topic)
+            {
+                sendto_one(sptr, rpl_str(RPL_TOPIC),
+                    me.name, sptr->name, chptr->chname, chptr->topic);
+            }
+            wol_names(cptr, sptr, 2, parv);
+        }
+    }
+
+    return 0;
+}
+
+int wol_userip(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    wol_reply reply;
+    wol_user *user;
+    aClient *acptr;
+    char prefix[BUFSIZE], line[BUFSIZE];
+    char *nick, *p = NULL;
+    const char *ip;
+    int prefix_len, len = 0, lines = 0, name_len, ip_len, from_wol, i;
+
+    WOL_TRACE_PARV(WOL_TC_USER, MSG_USERIP, sptr, parc, parv);
+
+    if (parc < 2)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "USERIP");
+        return 0;
+    }
+
+    prefix_len = snprintf(prefix, sizeof(prefix), ":%s %d %s :", me.name, RPL_USERIP, parv[0]);
+    wol_reply_init(&reply, sptr);
+    from_wol = wol_get_user(sptr) != NULL;
+
+    /* nick=+ip for everyone found, a WOL client gets the address CVERS
+       cached for other WOL users, which the games need to connect. Anyone
+       else only sees a real address for themselves or as an oper and the
+       host everyone sees otherwise, like the ircd's own USERIP. A full line
+       is sent before the next one is started */
+    for (i = 1; i < parc; i++)
+    {
+        for (nick = strtoken(&p, parv[i], ","); nick; nick = strtoken(&p, NULL, ","))
+        {
+            if ((acptr = find_person(nick, NULL)) == NULL)
+                continue;
+
+            if (from_wol && (user = wol_get_user(acptr)))
+            {
+                ip = user->ip;
+                ip_len = user->ip_len;
+            }
+            else
+            {
+                if (acptr == sptr || IsAnOper(sptr))
+                    ip = GetIP(acptr) ? GetIP(acptr) : "0.0.0.0";
+                else
+                    ip = GetHost(acptr);
+                ip_len = strlen(ip);
+            }
+
+            name_len = strlen(acptr->name);
+
+            if (len && prefix_len + len + name_len + ip_len + 3 > BUFSIZE - 2)
+            {
+                wol_reply_line(&reply, prefix, prefix_len, line, len);
+                lines++;
+                len = 0;
+            }
+
+            if (len)
+                line[len++] = ' ';
+
+            memcpy(line + len, acptr->name, name_len);
+            len += name_len;
+            line[len++] = '=';
+            line[len++] = '+';
+            memcpy(line + len, ip, ip_len);
+            len += ip_len;
+        }
+    }
+
+    if (len || !lines)
+        wol_reply_line(&reply, prefix, prefix_len, line, len);
+
+    wol_reply_flush(&reply);
+
+    return 0;
+}
+
+int wol_wolroom(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    char *entry, *p = NULL;
+
+    if (!IsServer(cptr) || parc < 2)
+        return 0;
+
+    /* passed on as it came, before the entries are cut up */
+    sendto_serv_butone_token(cptr, parv[0], MSG_WOLROOM, MSG_WOLROOM, ":%s", parv[1]);
+
+    for (entry = strtoken(&p, parv[1], " "); entry; entry = strtoken(&p, NULL, " "))
+    {
+        if (*entry == '+')
+            wol_sync_apply(entry + 1);
+    }
+
+    return 0;
+}
+
+int wol_gameopt(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_STATS_RUN(WOL_STAT_GAMEOPT, sptr, _wol_gameopt(cptr, sptr, parc, parv));
+}
+
+int _wol_gameopt(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_GAME, MSG_GAMEOPT, sptr, parc, parv);
+
+    if (parc < 3)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "GAMEOPT");
+        return 0;
+    }
+
+    if (parv[1][0] == '#')
+    {
+        aChannel *chptr = find_channel(parv[1], NULL);
+
+        if (!chptr)
+        {
+            sendto_one(sptr, err_str(ERR_NOSUCHCHANNEL), me.name, parv[0], parv[1]);
+            return 0;
+        }
+
+        wol_channel         *channel    = wol_get_channel(chptr);
+        wol_user            *user       = wol_get_user(sptr);
+        wol_gameopt_entry   *opt;
+        TS                  now         = TStime();
+
+        if (channel)
+            wol_room_touch(channel, now);
+
+        if (!channel || !user || gameopt_tick == 0)
+        {
+            sendto_channel_butserv(chptr, sptr, ":%s GAMEOPT %s :%s", sptr->name, chptr->chname, parv[2]);
+            gameopt_relayed++;
+            return 0;
+        }
+
+        /* don't let anything overtake what is already waiting */
+        if (channel->gameopts.first)
+            wol_gameopt_flush(channel, now, 0);
+
+        WOL_DLIST_FOREACH(channel->gameopts, opt, link)
+        {
+            if (opt->from == sptr)
+                break;
+        }
+
+        if (opt)
+        {
+            strlcpy(opt->payload, parv[2], sizeof(opt->payload));
+            gameopt_coalesced++;
+            return 0;
+        }
+
+        if (user->gameopt_sent + gameopt_tick <= now && wol_gameopt_allow(user, now))
+        {
+            sendto_channel_butserv(chptr, sptr, ":%s GAMEOPT %s :%s", sptr->name, chptr->chname, parv[2]);
+            user->gameopt_sent = now;
+            gameopt_relayed++;
+            return 0;
+        }
+
+        if ((opt = wol_pool_alloc(&gameopt_pool)) == NULL)
+        {
+            gameopt_dropped++;
+            return 0;
+        }
+
+        opt->from = sptr;
+        opt->queued = now;
+        strlcpy(opt->payload, parv[2], sizeof(opt->payload));
+
+        if (channel->gameopts.first == NULL)
+            WOL_DLIST_APPEND(gameopt_channels, channel, gameopt_link);
+        WOL_DLIST_APPEND(channel->gameopts, opt, link);
+
+        gameopt_deferred++;
+    }
+    else
+    {
+        aClient *clptr = find_person(parv[1], NULL);
+        wol_user *user = wol_get_user(sptr);
+
+        if (!clptr)
+        {
+            sendto_one(sptr, err_str(ERR_NOSUCHNICK), me.name, parv[0], parv[1]);
+            return 0;
+        }
+
+        if (user && !wol_gameopt_allow(user, TStime()))
+        {
+            gameopt_dropped++;
+            return 0;
+        }
+
+        gameopt_relayed++;
+
+        sendto_prefix_one(clptr, sptr, ":%s GAMEOPT %s :%s", parv[0], clptr->name, parv[2]);
+    }
+
+    return 0;
+}
+
+int wol_startg(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_STATS_RUN(WOL_STAT_STARTG, sptr, _wol_startg(cptr, sptr, parc, parv));
+}
+
+/*
+   Only the host of a game room can start it. The names the host sent are
+   matched against the room's members in one walk, with the IP cached at
+   CVERS, and keep the order the host sent them in; names that are not in
+   the room are left out. The line is formatted once and the same buffer is
+   queued to every local member. A game that doesn't fit in one line is
+   refused rather than started without some of its players.
+*/
+int _wol_startg(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    WOL_TRACE_PARV(WOL_TC_GAME, MSG_STARTG, sptr, parc, parv);
+
+    if (parc < 3)
+    {
+        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "STARTG");
+        return 0;
+    }
+
+    aChannel    *chptr      = find_channel(parv[1], NULL);
+    char        line[BUFSIZE];
+    char        tail[32];
+    char        *names[WOL_STARTG_MAX];
+    const char  *ips[WOL_STARTG_MAX];
+    char        *p, *name;
+    Member      *cm;
+    wol_user    *user;
+    wol_channel *channel;
+    int         count = 0, i, len, size, tail_len;
+
+    if (!chptr || (channel = wol_get_channel(chptr)) == NULL || channel->kind != WOL_CHANNEL_GAME)
+    {
+        sendto_one(sptr, err_str(ERR_NOSUCHCHANNEL), me.name, parv[0], parv[1]);
+        return 0;
+    }
+
+    if (!IsMember(sptr, chptr))
+    {
+        sendto_one(sptr, err_str(ERR_NOTONCHANNEL), me.name, parv[0], chptr->chname);
+        return 0;
+    }
+
+    if (!is_chan_op(sptr, chptr))
+    {
+        sendto_one(sptr, err_str(ERR_CHANOPRIVSNEEDED), me.name, parv[0], chptr->chname);
+        return 0;
+    }
+
+    for (name = strtoken(&p, parv[2], ","); name && count < WOL_STARTG_MAX; name = strtoken(&p, NULL, ","))
+    {
+        names[count] = name;
+        ips[count++] = NULL;
+    }
+
+    tail_len = sprintf(tail, ":%u %d\r\n", 1, (int)time(NULL));
+    len = sprintf(line, ":%s STARTG %s :", sptr->name, chptr->chname);
+    size = len + tail_len;
+
+    /* a name sent twice matches only once, the other one is left out */
+    for (cm = chptr->members; cm; cm = cm->next)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (ips[i] == NULL && !stricmp(names[i], cm->cptr->name))
+            {
+                user = wol_get_user(cm->cptr);
+                names[i] = cm->cptr->name;
+                ips[i] = user ? user->ip : GetIP(cm->cptr);
+                if (ips[i] == NULL)
+                    ips[i] = "0.0.0.0";
+                size += strlen(names[i]) + strlen(ips[i]) + 2;
+                break;
+            }
+        }
+    }
+
+    /* name is left over when the host sent more than any game takes */
+    if (name || size > (int)sizeof(line))
+    {
+        WOL_TRACE(WOL_TC_GAME, WOL_TRACE_INFO, "%p STARTG %s has more players than fit in one line", sptr, chptr->chname);
+        sendto_one(sptr, ":%s NOTICE %s :Too many players to start %s", me.name, parv[0], chptr->chname);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (ips[i])
+            len += sprintf(line + len, "%s %s ", names[i], ips[i]);
+    }
+
+    WOL_TRACE(WOL_TC_GAME, WOL_TRACE_INFO, "%s", line);
+
+    wol_room_start(channel);
+    wol_sync_touch(channel);
+
+    if (*game_log_path)
+        wol_gamelog_startg(sptr, chptr, channel, names, ips, count);
+
+    memcpy(line + len, tail, tail_len);
+    len += tail_len;
+
+    for (cm = chptr->members; cm; cm = cm->next)
+    {
+        if (MyConnect(cm->cptr))
+            sendbufto_one(cm->cptr, line, len);
+    }
+
+    return 0;
+}
+
+/*
+   WOLTRACE                 show trace level, category mask and event count
+   WOLTRACE LEVEL <1-4>     error, warn, info, debug
+   WOLTRACE MASK <hex>      categories, see WOL_TC_* in wol_trace.h
+   WOLTRACE DUMP [count]    send the most recent events as notices
+   WOLTRACE CLEAR
+*/
+int wol_woltrace(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    if (!IsAnOper(sptr))
+    {
+        sendto_one(sptr, err_str(ERR_NOPRIVILEGES), me.name, parv[0]);
+        return 0;
+    }
+
+    if (parc > 2 && !stricmp(parv[1], "LEVEL"))
+    {
+        wol_trace_level = atoi(parv[2]);
+    }
+    else if (parc > 2 && !stricmp(parv[1], "MASK"))
+    {
+        wol_trace_mask = strtoul(parv[2], NULL, 16);
+    }
+    else if (parc > 1 && !stricmp(parv[1], "CLEAR"))
+    {
+        wol_trace_clear();
+    }
+    else if (parc > 1 && !stricmp(parv[1], "DUMP"))
+    {
+        static wol_trace_entry entries[WOL_TRACE_RING];
+        wol_reply reply;
+        int count = (parc > 2) ? atoi(parv[2]) : 50;
+        int n, i;
+
+        n = wol_trace_snapshot(entries, count);
+
+        wol_reply_init(&reply, sptr);
+        for (i = 0; i < n; i++)
+        {
+            wol_reply_printf(&reply, ":%s NOTICE %s :%ld.%03ld %d %02X %s",
+                    me.name,
+                    sptr->name,
+                    (long)entries[i].tv.tv_sec,
+                    (long)entries[i].tv.tv_usec / 1000,
+                    entries[i].level,
+                    entries[i].category,
+                    entries[i].msg);
+        }
+        wol_reply_flush(&reply);
+        return 0;
+    }
+
+    sendto_one(sptr, ":%s NOTICE %s :m_wol trace level %d mask %02X, %u events",
+            me.name,
+            sptr->name,
+            wol_trace_level,
+            wol_trace_mask,
+            wol_trace_head);
+
+    return 0;
+}
+
+void wol_format_ns(char *buf, size_t len, uint64_t ns)
+{
+    if (ns < 1000)
+        snprintf(buf, len, "%uns", (unsigned int)ns);
+    else if (ns < 1000000)
+        snprintf(buf, len, "%uus", (unsigned int)(ns / 1000));
+    else if (ns < 1000000000)
+        snprintf(buf, len, "%ums", (unsigned int)(ns / 1000000));
+    else
+        snprintf(buf, len, "%us", (unsigned int)(ns / 1000000000));
+}
+
+/*
+   WOLSTATS                 registry sizes and per command statistics
+   WOLSTATS RESET           zero the command statistics
+*/
+int wol_wolstats(aClient *cptr, aClient *sptr, int parc, char *parv[])
+{
+    wol_reply reply;
+    char line[BUFSIZE];
+    char avg[16], max[16], p50[16], p99[16];
+    unsigned int plain;
+    int i, len;
+
+    if (!IsAnOper(sptr))
+    {
+        sendto_one(sptr, err_str(ERR_NOPRIVILEGES), me.name, parv[0]);
+        return 0;
+    }
+
+    if (parc > 1 && !stricmp(parv[1], "RESET"))
+    {
+        wol_stats_reset();
+        sendto_one(sptr, ":%s NOTICE %s :m_wol statistics reset", me.name, sptr->name);
+        return 0;
+    }
+
+    wol_reply_init(&reply, sptr);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :users %u (peak %u), channels %u (peak %u), hash slots %u+%u",
+            me.name, sptr->name,
+            user_index.count, user_pool.peak,
+            channel_index.count, channel_pool.peak,
+            user_index.size, channel_index.size);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :lobbies %u", me.name, sptr->name, lobby_count);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :serials banned %u, checked %lu banned %lu in use %lu, online %u",
+            me.name, sptr->name,
+            serial_db ? serial_db->count : 0,
+            serial_checked, serial_banned, serial_in_use, serial_index.count);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :accounts %u (%u buckets), APGAR ok %lu bad %lu unknown %lu",
+            me.name, sptr->name,
+            account_db ? account_db->count : 0,
+            account_db ? account_db->buckets : 0,
+            account_ok, account_bad, account_unknown);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :game log queued %lu dropped %lu written %lu syncs %lu rotations %lu errors %lu, %u bytes waiting",
+            me.name, sptr->name,
+            gamelog.queued, gamelog.dropped,
+            WOL_ACQUIRE(gamelog.written), WOL_ACQUIRE(gamelog.syncs),
+            WOL_ACQUIRE(gamelog.rotations), WOL_ACQUIRE(gamelog.errors),
+            gamelog.head - WOL_ACQUIRE(gamelog.tail));
+
+    plain = irc_channels > channel_index.count ? irc_channels - channel_index.count : 0;
+    wol_reply_printf(&reply, ":%s NOTICE %s :channels lobby %u game %u, %u plain ones not tracked saving %lu bytes",
+            me.name, sptr->name,
+            channels_by_kind[WOL_CHANNEL_LOBBY], channels_by_kind[WOL_CHANNEL_GAME],
+            plain, (unsigned long)plain * (sizeof(wol_channel) + 2 * sizeof(void *)));
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :rooms timed %u, hidden after STARTG %lu, reaped idle %lu",
+            me.name, sptr->name, reap_count, rooms_hidden, rooms_reaped);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :WOLROOM sent %lu entries in %lu lines, %lu bursts, applied %lu unknown %lu",
+            me.name, sptr->name,
+            sync_entries, sync_lines, sync_bursts, sync_applied, sync_unknown);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :joins refused full %lu key %lu started %lu",
+            me.name, sptr->name, joins_full, joins_key, joins_started);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :GAMEOPT relayed %lu deferred %lu coalesced %lu flushed %lu dropped %lu pending %u",
+            me.name, sptr->name,
+            gameopt_relayed, gameopt_deferred, gameopt_coalesced, gameopt_flushed, gameopt_dropped,
+            gameopt_pool.live);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :logins direct %lu queued %lu refused %lu waiting %u (peak %u) wait avg %lus max %lus",
+            me.name, sptr->name,
+            login_direct, login_queued, login_refused,
+            login_pool.live, login_pool.peak,
+            login_replayed ? login_wait / login_replayed : 0, login_wait_max);
+
+    wol_reply_printf(&reply, ":%s NOTICE %s :LIST watchers %u watches %lu updates %lu removes %lu",
+            me.name, sptr->name,
+            watch_count, watch_lists, watch_updates, watch_removes);
+
+    len = 0;
+    for (i = 0; i < WOL_TYPE_BUCKETS; i++)
+    {
+        if (channels_by_type_count[i] == 0)
+            continue;
+
+        if (len > 400)
+        {
+            wol_reply_printf(&reply, ":%s NOTICE %s :rooms by type:%s", me.name, sptr->name, line);
+            len = 0;
+        }
+
+        if (i == 0)
+            len += snprintf(line + len, sizeof(line) - len, " other:%u", channels_by_type_count[i]);
+        else
+            len += snprintf(line + len, sizeof(line) - len, " %d:%u", i, channels_by_type_count[i]);
+    }
+
+    if (len)
+        wol_reply_printf(&reply, ":%s NOTICE %s :rooms by type:%s", me.name, sptr->name, line);
+
+    for (i = 0; i < WOL_STAT_MAX; i++)
+    {
+        wol_stats_cmd *stat = &wol_stats[i];
+        int bucket;
+
+        wol_format_ns(avg, sizeof(avg), stat->calls ? stat->ns / stat->calls : 0);
+        wol_format_ns(max, sizeof(max), stat->max_ns);
+        wol_format_ns(p50, sizeof(p50), wol_stats_percentile(stat, 50));
+        wol_format_ns(p99, sizeof(p99), wol_stats_percentile(stat, 99));
+
+        wol_reply_printf(&reply, ":%s NOTICE %s :%s calls %lu bytes %llu avg %s max %s p50 <%s p99 <%s",
+                me.name, sptr->name,
+                stat->name,
+                stat->calls,
+                (unsigned long long)stat->bytes,
+                avg, max, p50, p99);
+
+        len = 0;
+        for (bucket = 0; bucket < WOL_STATS_BUCKETS; bucket++)
+        {
+            if (stat->hist[bucket] == 0)
+                continue;
+
+            wol_format_ns(avg, sizeof(avg), 1ULL << bucket);
+            len += snprintf(line + len, sizeof(line) - len, " <%s:%lu", avg, stat->hist[bucket]);
+        }
+
+        if (len)
+            wol_reply_printf(&reply, ":%s NOTICE %s :%s histogram%s", me.name, sptr->name, stat->name, line);
+    }
+
+    wol_reply_flush(&reply);
+
+    return 0;
+}
+
+DLLFUNC EVENT(wol_gameopt_tick)
+{
+    wol_channel *channel, *next;
+    TS now = TStime();
+
+    WOL_DLIST_FOREACH_SAFE(gameopt_channels, channel, next, gameopt_link)
+    {
+        wol_gameopt_flush(channel, now, 0);
+    }
+}
+
+DLLFUNC EVENT(wol_watch_tick)
+{
+    wol_channel *channel, *nextc;
+    wol_watch_gone *gone, *nextg;
+    wol_user *user;
+    wol_reply reply;
+    char prefix[BUFSIZE];
+    char *cached;
+    int bucket, prefix_len, len;
+    TS now = TStime();
+
+    if (now - watch_sent < list_tick)
+        return;
+
+    for (bucket = 0; bucket < WOL_TYPE_BUCKETS; bucket++)
+    {
+        if (watch_dirty[bucket].first == NULL && watch_gone[bucket].first == NULL)
+            continue;
+
+        watch_sent = now;
+
+        WOL_DLIST_FOREACH(watchers[bucket], user, watch_link)
+        {
+            wol_reply_init(&reply, user->p);
+
+            WOL_DLIST_FOREACH(watch_gone[bucket], gone, link)
+            {
+                if (gone->type == user->watch_type)
+                {
+                    wol_reply_printf(&reply, ":%s %d %s %s 0 0 %d 0 0 0 0::",
+                            me.name, RPL_LISTGAME, user->p->name, gone->name, gone->type);
+                    watch_removes++;
+                }
+            }
+
+            prefix_len = snprintf(prefix, sizeof(prefix), ":%s %d %s ", me.name, RPL_LISTGAME, user->p->name);
+
+            WOL_DLIST_FOREACH(watch_dirty[bucket], channel, watch_link)
+            {
+                if (channel->type == user->watch_type)
+                {
+                    len = wol_channel_list_line(channel, &cached);
+                    wol_reply_line(&reply, prefix, prefix_len, cached, len);
+                    watch_updates++;
+                }
+            }
+
+            wol_reply_flush(&reply);
+        }
+
+        WOL_DLIST_FOREACH_SAFE(watch_dirty[bucket], channel, nextc, watch_link)
+        {
+            channel->watch_dirty = 0;
+        }
+
+        WOL_DLIST_FOREACH_SAFE(watch_gone[bucket], gone, nextg, link)
+        {
+            wol_pool_free(&watch_pool, gone);
+        }
+
+        WOL_DLIST_INIT(watch_dirty[bucket]);
+        WOL_DLIST_INIT(watch_gone[bucket]);
+    }
+}
+
+DLLFUNC EVENT(wol_reap_tick)
+{
+    wol_channel *channel, *next;
+    TS now = TStime();
+
+    /* a late tick catches up, one turn covers every slot */
+    if (now - reap_now > WOL_REAP_SLOTS)
+        reap_now = now - WOL_REAP_SLOTS;
+
+    while (reap_now < now)
+    {
+        reap_now++;
+
+        WOL_DLIST_FOREACH_SAFE(reap_wheel[reap_now & (WOL_REAP_SLOTS - 1)], channel, next, reap_link)
+        {
+            int idle = wol_room_idle(channel);
+
+            /* due on a later turn */
+            if (channel->reap_due > reap_now)
+                continue;
+
+            if (idle && channel->active + idle <= reap_now)
+            {
+                WOL_DLIST_UNLINK(reap_wheel[reap_now & (WOL_REAP_SLOTS - 1)], channel, reap_link);
+                channel->reap_due = 0;
+                reap_count--;
+                wol_room_empty(channel);
+                continue;
+            }
+
+            if (channel->started && !channel->hidden && channel->started + wol_room_started(channel) <= reap_now)
+            {
+                wol_room_hide(channel);
+                rooms_hidden++;
+            }
+
+            wol_room_schedule(channel);
+        }
+    }
+}
+
+DLLFUNC EVENT(wol_sync_tick)
+{
+    wol_sync_batch batch = { NULL, 0 };
+    wol_channel *channel, *nextc;
+
+    if (sync_dirty.first == NULL)
+        return;
+
+    WOL_DLIST_FOREACH_SAFE(sync_dirty, channel, nextc, sync_link)
+    {
+        channel->sync_dirty = 0;
+        wol_sync_room(&batch, channel);
+    }
+
+    WOL_DLIST_INIT(sync_dirty);
+
+    wol_sync_send(&batch);
+}
+
+DLLFUNC EVENT(wol_login_tick)
+{
+    TS now = TStime();
+    int i;
+
+    for (i = 0; i < login_drain && logins.first; i++)
+        wol_login_run(logins.first, now);
+}
+
+/*
+   wol {
+       lobby "#Lob_21_0" { game 21; };
+       lobby "#Lob_21_1" { game 21; };
+       room 21 { idle 900; started 30; };
+       serials "banned.db";
+       accounts "accounts.db";
+       game-log "games.log";
+       game-log-size 64;
+       game-log-sync 5;
+       snapshot 1;
+       gameopt-tick 1;
+       gameopt-rate 10;
+       gameopt-burst 20;
+       login-rate 50;
+       login-burst 200;
+       login-ip-rate 2;
+       login-ip-burst 5;
+       login-queue 1000;
+       login-drain 50;
+       list-tick 1;
+   };
+*/
+DLLFUNC int wol_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs)
+{
+    ConfigEntry *cep, *cepp;
+    wol_setting *setting;
+    int errors = 0;
+
+    if (type != CONFIG_MAIN || !ce || !ce->ce_varname || strcmp(ce->ce_varname, "wol"))
+        return 0;
+
+    for (cep = ce->ce_entries; cep; cep = cep->ce_next)
+    {
+        if (!strcmp(cep->ce_varname, "lobby"))
+        {
+            int game = 0;
+
+            if (!cep->ce_vardata || *cep->ce_vardata != '#' || strlen(cep->ce_vardata) > CHANNELLEN)
+            {
+                config_error("%s:%i: wol::lobby needs a channel name",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+                errors++;
+                continue;
+            }
+
+            for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+            {
+                if (!strcmp(cepp->ce_varname, "game") && cepp->ce_vardata)
+                {
+                    game = atoi(cepp->ce_vardata);
+                }
+                else
+                {
+                    config_error("%s:%i: unknown directive wol::lobby::%s",
+                            cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum, cepp->ce_varname);
+                    errors++;
+                }
+            }
+
+            if (game <= 0)
+            {
+                config_error("%s:%i: wol::lobby %s needs a game type",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum, cep->ce_vardata);
+                errors++;
+            }
+        }
+        else if (!strcmp(cep->ce_varname, "room"))
+        {
+            int game = cep->ce_vardata ? atoi(cep->ce_vardata) : 0;
+
+            if (!cep->ce_vardata || !_is_numeric(cep->ce_vardata) || game <= 0 || game >= WOL_TYPE_BUCKETS)
+            {
+                config_error("%s:%i: wol::room needs a game type between 1 and %d",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum, WOL_TYPE_BUCKETS - 1);
+                errors++;
+                continue;
+            }
+
+            for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+            {
+                if (strcmp(cepp->ce_varname, "idle") && strcmp(cepp->ce_varname, "started"))
+                {
+                    config_error("%s:%i: unknown directive wol::room::%s",
+                            cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum, cepp->ce_varname);
+                    errors++;
+                }
+                else if (!cepp->ce_vardata || !_is_numeric(cepp->ce_vardata) || atoi(cepp->ce_vardata) > 86400)
+                {
+                    config_error("%s:%i: wol::room::%s must be between 0 and 86400",
+                            cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum, cepp->ce_varname);
+                    errors++;
+                }
+            }
+        }
+        else if (!strcmp(cep->ce_varname, "serials"))
         {
-            int list_type = atoi(parv[1]);
-            int game_type = atoi(parv[2]);
+            const wol_serial_header *header;
+            size_t size;
 
-            dprintf(" detected WOL LIST, returning custom list");
+            if (!cep->ce_vardata || (header = wol_serial_open(cep->ce_vardata, &size)) == NULL)
+            {
+                config_error("%s:%i: wol::serials needs a database made with tools/wol_serials",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+                errors++;
+                continue;
+            }
 
-            sendto_one(sptr, rpl_str(RPL_LISTSTART), me.name, parv[0]);
+            wol_unmap(header, size);
+        }
+        else if (!strcmp(cep->ce_varname, "accounts"))
+        {
+            const wol_account_header *header;
+            size_t size;
 
-            /* list specific game type rooms */
-            if (list_type)
+            if (!cep->ce_vardata || (header = wol_account_open(cep->ce_vardata, &size)) == NULL)
             {
-                wol_channel *channel;
-                WOL_LIST_FOREACH(channels, channel)
-                {
-                    if (channel->type == list_type)
-                    {
-                        sendto_one(sptr, ":%s %d %s %s %d %d %d %d %u %u %u::%s",
-                                me.name,
-                                RPL_LISTGAME,
-                                parv[0],
-                                channel->p->chname,
-                                channel->p->users,
-                                channel->maxUsers,
-                                channel->type,
-                                channel->tournament,
-                                channel->reserved,
-                                channel->ipaddr,
-                                channel->flags,
-                                channel->p->topic);
-                    }
-                }
+                config_error("%s:%i: wol::accounts needs a database made with tools/wol_accounts",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+                errors++;
+                continue;
             }
-            else
+
+            wol_unmap(header, size);
+        }
+        else if (!strcmp(cep->ce_varname, "game-log"))
+        {
+#ifndef _WIN32
+            if (!cep->ce_vardata || !*cep->ce_vardata || strlen(cep->ce_vardata) >= sizeof(gamelog.path))
             {
-                /* emulate a single RA lobby for now */
-                sendto_one(sptr, ":%s %d %s %s %d %d %d", me.name, RPL_LISTLOBBY, parv[0], "#Lob_21_0", 0, 0, 0);
+                config_error("%s:%i: wol::game-log needs a file name",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+                errors++;
             }
+#else
+            config_error("%s:%i: wol::game-log is not supported on Windows",
+                    cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+            errors++;
+#endif
+        }
+        else if ((setting = wol_setting_find(cep->ce_varname)))
+        {
+            int value = cep->ce_vardata ? atoi(cep->ce_vardata) : -1;
 
-            sendto_one(sptr, rpl_str(RPL_LISTEND), me.name, parv[0]);
-            return 0;
+            if (!cep->ce_vardata || !_is_numeric(cep->ce_vardata) || value < setting->min || value > setting->max)
+            {
+                config_error("%s:%i: wol::%s must be between %d and %d",
+                        cep->ce_fileptr->cf_filename, cep->ce_varlinenum, cep->ce_varname,
+                        setting->min, setting->max);
+                errors++;
+            }
+        }
+        else
+        {
+            config_error("%s:%i: unknown directive wol::%s",
+                    cep->ce_fileptr->cf_filename, cep->ce_varlinenum, cep->ce_varname);
+            errors++;
         }
     }
 
-    return CallCmdoverride(_list, cptr, sptr, parc, parv);
+    *errs = errors;
+    return errors ? -1 : 1;
 }
 
-int wol_join(Cmdoverride *anoverride, aClient *cptr, aClient *sptr, int parc, char *parv[])
+DLLFUNC int wol_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 {
-    dprintf("wol_join(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    ConfigEntry *cep, *cepp;
+    wol_setting *setting;
 
-    wol_user    *user       = wol_get_user(cptr);
-    aChannel    *chptr      = find_channel(parv[1], NULL);
-    wol_channel *channel    = wol_get_channel(chptr);
+    if (type != CONFIG_MAIN || !ce || !ce->ce_varname || strcmp(ce->ce_varname, "wol"))
+        return 0;
 
-    if (user)
+    for (cep = ce->ce_entries; cep; cep = cep->ce_next)
     {
-        chptr = get_channel(sptr, parv[1], CREATE);
-
-        dprintf(" detected WOL JOIN, returning custom reply");
-
-        /* hack when the module is reloaded and state is lost */
-        if (!channel)
+        if (!strcmp(cep->ce_varname, "lobby"))
         {
-            wol_hook_channel_create(NULL, chptr);
-            channel = wol_get_channel(chptr);
+            for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+            {
+                if (!strcmp(cepp->ce_varname, "game"))
+                    wol_lobby_add(cep->ce_vardata, atoi(cepp->ce_vardata));
+            }
         }
+        else if (!strcmp(cep->ce_varname, "room"))
+        {
+            wol_room_timeout *timeout = &room_timeouts[atoi(cep->ce_vardata)];
 
-        dprintf(" chptr=%p, channel=%p", chptr, channel);
-
-        /* FIXME: check if the channel is joinable */
-        if (channel)
+            for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+            {
+                if (!strcmp(cepp->ce_varname, "idle"))
+                    timeout->idle = atoi(cepp->ce_vardata);
+                else if (!strcmp(cepp->ce_varname, "started"))
+                    timeout->started = atoi(cepp->ce_vardata);
+            }
+        }
+        else if (!strcmp(cep->ce_varname, "serials"))
         {
-            /* read in the WOL channel settings from parv */
+            const wol_serial_header *header;
+            size_t size;
 
-            add_user_to_channel(chptr, sptr, 0);
+            serial_seen = 1;
 
-            sendto_channel_butserv(chptr, sptr,
-                ":%s JOIN :0,0 %s", sptr->name, chptr->chname);
-            
-            sendto_serv_butone_token_opt(cptr, OPT_NOT_SJ3, sptr->name, "JOIN",
-                    TOK_JOIN, "%s", chptr->chname);
+            /* if the file went bad since the test keep using the old one */
+            if ((header = wol_serial_open(cep->ce_vardata, &size)) == NULL)
+            {
+                sendto_realops("m_wol: %s is not a serial database any more, keeping the old one",
+                        cep->ce_vardata);
+            }
+            else
+            {
+                wol_serial_close();
+                serial_db = header;
+                serial_db_size = size;
+            }
+        }
+        else if (!strcmp(cep->ce_varname, "accounts"))
+        {
+            const wol_account_header *header;
+            size_t size;
 
-            if (MyClient(sptr))
+            account_seen = 1;
+
+            /* if the file went bad since the test keep using the old one */
+            if ((header = wol_account_open(cep->ce_vardata, &size)) == NULL)
             {
-                del_invite(sptr, chptr);
-                if (chptr->topic)
-                {
-                    sendto_one(sptr, rpl_str(RPL_TOPIC),
-                        me.name, sptr->name, chptr->chname, chptr->topic);
-                }
-                wol_names(cptr, sptr, 2, parv);
+                sendto_realops("m_wol: %s is not an account database any more, keeping the old one",
+                        cep->ce_vardata);
+            }
+            else
+            {
+                wol_account_close();
+                account_db = header;
+                account_db_size = size;
             }
         }
-        return 0;
-    }
-    else if (channel)
-    {
-        /* deny access from normal IRC users as their clients would only get messed up */
-        sendto_one(sptr, err_str(ERR_BANNEDFROMCHAN), me.name, parv[0], parv[1]);
-        return 0;
+        else if (!strcmp(cep->ce_varname, "game-log"))
+        {
+            /* the writer picks it up with the next STARTG */
+            strlcpy(game_log_path, cep->ce_vardata, sizeof(game_log_path));
+        }
+        else if ((setting = wol_setting_find(cep->ce_varname)))
+        {
+            *setting->value = atoi(cep->ce_vardata);
+        }
     }
 
-    /* if call was forwarded from joingame, don't */
-    if (anoverride == NULL)
-    {
-        return 0;
-    }
+    return 1;
+}
 
-    return CallCmdoverride(_join, cptr, sptr, parc, parv);
+DLLFUNC int wol_config_rehash()
+{
+    wol_lobby_clear();
+    wol_settings_reset();
+    wol_room_timeouts_reset();
+    *game_log_path = '\0';
+    serial_seen = 0;
+    account_seen = 0;
+    return 1;
 }
 
-int wol_joingame(aClient *cptr, aClient *sptr, int parc, char *parv[])
+DLLFUNC int wol_config_rehash_complete()
 {
-    dprintf("wol_joingame(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    /* wol::serials or wol::accounts was taken out */
+    if (!serial_seen)
+        wol_serial_close();
+    if (!account_seen)
+        wol_account_close();
+    return 1;
+}
 
-    if (parc != 3 && parc != 4 && parc != 9)
-    {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
-        return 0;
-    }
+/* the wol_channel comes with the first WOL join or JOINGAME, only the
+   configured lobbies are looked up here */
+DLLFUNC int wol_hook_channel_create(aClient *cptr, aChannel *chptr)
+{
+    WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "wol_hook_channel_create(cptr=%p, chptr=%p)", cptr, chptr);
 
-    /* handle buggy JOIN from RA */
-    if (parc == 4)
-    {
-        return wol_join(NULL, cptr, sptr, parc, parv);
-    }
+    wol_lobby   *lobby   = wol_lobby_find(chptr->chname);
 
-    int         flags       = (ChannelExists(parv[1])) ? CHFL_DEOPPED : LEVEL_ON_JOIN;
-    aChannel    *chptr      = get_channel(sptr, parv[1], CREATE);
-    wol_channel *channel    = wol_get_channel(chptr);
+    irc_channels++;
 
-    if (flags == LEVEL_ON_JOIN && parc < 9)
+    if (lobby)
     {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
-        return 0;
+        lobby->p = chptr;
     }
 
-    if (!channel && (flags != LEVEL_ON_JOIN))
+    return 0;
+}
+
+DLLFUNC int wol_hook_channel_destroy(aChannel *chptr)
+{
+    WOL_TRACE(WOL_TC_CHAN, WOL_TRACE_DEBUG, "wol_hook_channel_destroy(chptr=%p)", chptr);
+    wol_channel *channel    = wol_hash_del(&channel_index, chptr);
+    wol_lobby   *lobby;
+
+    WOL_DLIST_FOREACH(lobbies, lobby, link)
     {
-        dprintf(" no game channel while joining, this is a bug!");
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "JOINGAME");
-        return 0;
+        if (lobby->p == chptr)
+            lobby->p = NULL;
     }
 
-    dprintf(" chptr=%p, channel=%p", chptr, channel);
+    if (irc_channels)
+        irc_channels--;
 
-    /* FIXME: check if the channel is joinable */
     if (channel)
     {
-        if (flags == LEVEL_ON_JOIN)
-        {
-            /* read in the WOL channel settings from parv */
-            channel->minUsers   = atoi(parv[2]);
-            channel->maxUsers   = atoi(parv[3]);
-            channel->type       = atoi(parv[4]);
-            channel->tournament = atoi(parv[7]);
-            channel->reserved   = atoi(parv[8]);
-
-            if (parc > 9)
-            {
-                // 9 == key if exists
-            }
-        }
-
-        add_user_to_channel(chptr, sptr, flags);
+        if (channel->sync_dirty)
+            WOL_DLIST_UNLINK(sync_dirty, channel, sync_link);
 
-        sendto_channel_butserv(chptr, sptr,
-            ":%s JOINGAME %d %d %d %d %u %u %u :%s",
-            sptr->name,
-            channel->minUsers,
-            channel->maxUsers,
-            channel->type,
-            channel->tournament,
-            0, /* unk */
-            0, /* host ipaddr, not used */
-            channel->flags,
-            chptr->chname);
-        
-        if (MyClient(sptr))
+        wol_channel_set_type(channel, 0);
+        if (channel->reap_due)
         {
-            del_invite(sptr, chptr);
-            if (chptr->topic)
-            {
-                sendto_one(sptr, rpl_str(RPL_TOPIC),
-                    me.name, sptr->name, chptr->chname, chptr->topic);
-            }
-            wol_names(cptr, sptr, 2, parv);
+            WOL_DLIST_UNLINK(reap_wheel[channel->reap_due & (WOL_REAP_SLOTS - 1)], channel, reap_link);
+            reap_count--;
         }
+        WOL_DLIST_UNLINK(channels, channel, link);
+        channels_by_kind[channel->kind]--;
+        WOL_FREE(channel->list_line);
+        wol_names_clear(channel);
+        wol_gameopt_forget(channel, NULL);
     }
 
+    wol_pool_free(&channel_pool, channel);
+
     return 0;
 }
 
-int wol_userip(aClient *cptr, aClient *sptr, int parc, char *parv[])
+/* runs after the burst, the channels are over there and every game room
+   follows them */
+DLLFUNC int wol_hook_server_connect(aClient *cptr)
 {
-    dprintf("wol_userip(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    wol_sync_batch batch = { cptr, 0 };
+    wol_channel *channel;
+
+    if (!MyConnect(cptr))
+        return 0;
+
+    WOL_DLIST_FOREACH(channels, channel, link)
+    {
+        if (channel->kind == WOL_CHANNEL_GAME)
+            wol_sync_room(&batch, channel);
+    }
 
-    /* I don't think this needs to be implemented at all */
+    wol_sync_send(&batch);
+    sync_bursts++;
 
     return 0;
 }
 
-int wol_gameopt(aClient *cptr, aClient *sptr, int parc, char *parv[])
+DLLFUNC int wol_hook_topic(aClient *cptr, aClient *sptr, aChannel *chptr, char *topic)
 {
-    dprintf("wol_gameopt(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    wol_channel *channel    = wol_get_channel(chptr);
 
-    if (parc < 3)
+    if (channel)
     {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "GAMEOPT");
-        return 0;
+        wol_channel_invalidate(channel);
     }
 
-    if (parv[1][0] == '#')
-    {
-        aChannel *chptr = find_channel(parv[1], NULL);
+    return 0;
+}
 
-        if (!chptr)
-        {
-            sendto_one(sptr, err_str(ERR_NOSUCHCHANNEL), me.name, parv[0], parv[1]);
-            return 0;
-        }
+DLLFUNC int wol_hook_join(aClient *cptr, aClient *sptr, aChannel *chptr, char *parv[])
+{
+    wol_channel *channel    = wol_get_channel(chptr);
 
-        sendto_channel_butserv(chptr, sptr, ":%s GAMEOPT %s :%s", sptr->name, chptr->chname, parv[2]);
-    }
-    else
+    if (channel)
     {
-        aClient *clptr = find_person(parv[1], NULL);
-
-        if (!clptr)
-        {
-            sendto_one(sptr, err_str(ERR_NOSUCHNICK), me.name, parv[0], parv[1]);
-            return 0;
-        }
-
-        sendto_prefix_one(clptr, sptr, ":%s GAMEOPT %s :%s", parv[0], clptr->name, parv[2]);
+        wol_names_joined(channel, sptr);
+        wol_watch_touch(channel);
     }
 
     return 0;
 }
 
-int wol_startg(aClient *cptr, aClient *sptr, int parc, char *parv[])
+DLLFUNC int wol_hook_part(aClient *cptr, aClient *sptr, aChannel *chptr, char *comment)
 {
-    dprintf("wol_startg(cptr=%p, sptr=%p, parc=%d, parv=%p)", cptr, sptr, parc, parv);
-    int i;
-    for (i = 0; i < parc; i++)
-        dprintf(" parv[%d]: \"%s\"", i, parv[i]);
+    wol_channel *channel    = wol_get_channel(chptr);
 
-    if (parc < 3)
+    if (channel)
     {
-        sendto_one(sptr, err_str(ERR_NEEDMOREPARAMS), me.name, parv[0], "GAMEOPT");
-        return 0;
+        wol_names_del(channel, sptr);
+        wol_gameopt_forget(channel, sptr);
+        wol_watch_touch(channel);
     }
 
+    return 0;
+}
 
-    aChannel *chptr = find_channel(parv[1], NULL);
-    char *p;
-    char *name;
-    char users[512] = { 0 };
-    char buf[64];
-    name = strtoken(&p, parv[2], ",");
-    do
-    {
-        aClient *clptr = find_person(name, NULL);
-
-        if (clptr)
-        {
-            snprintf(buf, 64, "%s %s ", name, GetIP(clptr));
-            strlcat(users, buf, sizeof(users));
-        }
-
-    } while(name = strtoken(&p, NULL, ","));
+DLLFUNC int wol_hook_kick(aClient *cptr, aClient *sptr, aClient *who, aChannel *chptr, char *comment)
+{
+    wol_channel *channel    = wol_get_channel(chptr);
 
-    dprintf(":%s STARTG %s :%s :%u %d", sptr->name, chptr->chname, users, 1, (int)time(NULL));
-    sendto_channel_butserv(chptr, sptr, ":%s STARTG %s :%s:%u %d", sptr->name, chptr->chname, users, 1, (int)time(NULL));
+    if (channel)
+    {
+        wol_names_del(channel, who);
+        wol_gameopt_forget(channel, who);
+        wol_watch_touch(channel);
+    }
 
     return 0;
 }
 
-DLLFUNC int wol_hook_channel_create(aClient *cptr, aChannel *chptr)
+/* op and voice changes move the prefix, not worth patching in place */
+DLLFUNC int wol_hook_chanmode(aClient *cptr, aClient *sptr, aChannel *chptr)
 {
-    dprintf("wol_hook_channel_create(cptr=%p, chptr=%p)", cptr, chptr);
+    wol_channel *channel    = wol_get_channel(chptr);
 
-    wol_channel *channel = WOL_ALLOC(sizeof(wol_channel));
-    channel->p = chptr;
-    WOL_LIST_INSERT(channels, channel);
+    if (channel)
+    {
+        channel->names_stale = 1;
+    }
 
     return 0;
 }
 
-DLLFUNC int wol_hook_channel_destroy(aChannel *chptr)
+void wol_names_nickchange(aClient *sptr)
 {
-    dprintf("wol_hook_channel_destroy(chptr=%p)", chptr);
-    wol_channel *channel    = wol_get_channel(chptr);
+    wol_channel *channel;
+    Membership  *mp;
 
-    if (channel)
+    for (mp = sptr->user ? sptr->user->channel : NULL; mp; mp = mp->next)
     {
-        WOL_LIST_REMOVE(channels, channel);
+        if ((channel = wol_get_channel(mp->chptr)))
+            channel->names_stale = 1;
     }
+}
 
-    WOL_FREE(channel);
+DLLFUNC int wol_hook_local_nickchange(aClient *sptr, char *nick)
+{
+    wol_names_nickchange(sptr);
+    return 0;
+}
 
+DLLFUNC int wol_hook_remote_nickchange(aClient *cptr, aClient *sptr, char *nick)
+{
+    wol_names_nickchange(sptr);
     return 0;
 }
 
 int wol_hook_quit(aClient *cptr, char *comment)
 {
-    dprintf("wol_hook_quit(cptr=%p, comment=\"%s\")", cptr, comment);
+    /* same shape as WOL_TRACE_PARV so a recorded session ends with it */
+    WOL_TRACE(WOL_TC_USER, WOL_TRACE_DEBUG, "%p %s QUIT :%s", cptr, cptr->name, comment ? comment : "");
 
-    wol_user    *user       = wol_get_user(cptr);
+    wol_user    *user       = wol_hash_del(&user_index, cptr);
+    wol_login   *login      = wol_hash_get(&login_index, cptr);
+    wol_channel *channel;
+    Membership  *mp;
+
+    if (login)
+    {
+        wol_login_release(login);
+    }
+
+    WOL_TRACE(WOL_TC_USER, WOL_TRACE_DEBUG, "%p user %p", cptr, user);
+
+    for (mp = cptr->user ? cptr->user->channel : NULL; mp; mp = mp->next)
+    {
+        if ((channel = wol_get_channel(mp->chptr)))
+        {
+            wol_names_del(channel, cptr);
+            wol_gameopt_forget(channel, cptr);
+            wol_watch_touch(channel);
+        }
+    }
 
-    dprintf(" users %p", users);
-    dprintf(" user %p", user);
+    if (user)
+    {
+        wol_watch_stop(user);
+        wol_serial_offline(user);
+        WOL_DLIST_UNLINK(users, user, link);
+    }
 
-    WOL_LIST_REMOVE(users, user);
-    WOL_FREE(user);
+    wol_pool_free(&user_pool, user);
 
     return 0;
 }
 
+DLLFUNC CMD_FUNC(wol_names)
+{
+    WOL_STATS_RUN(WOL_STAT_NAMES, sptr, _wol_names(cptr, sptr, parc, parv));
+}
+
 static char buf[BUFSIZE];
 #define TRUNCATED_NAMES 64
-DLLFUNC CMD_FUNC(wol_names)
+CMD_FUNC(_wol_names)
 {
     int bufLen = NICKLEN + 4; /* extra = ,0,0 */
     int  mlen = strlen(me.name) + bufLen + 7;
     aChannel *chptr;
+    wol_channel *channel;
     aClient *acptr;
     int  member;
     Member *cm;
     int  idx, flag = 1, spos;
     char *s, *para = parv[1];
-    char nuhBuffer[NICKLEN+USERLEN+HOSTLEN+3];
-
 
     if (parc < 2 || !MyConnect(sptr))
     {
@@ -724,6 +4035,42 @@ DLLFUNC CMD_FUNC(wol_names)
     /* cache whether this user is a member of this channel or not */
     member = IsMember(sptr, chptr);
 
+    if ((channel = wol_get_channel(chptr)) && (member || IsNetAdmin(sptr))
+        && (channel->names_stale || channel->names_count != chptr->users))
+        wol_names_rebuild(channel);
+
+    /* the cached reply has everyone in it, invisible members included. One
+       that could not be rebuilt is left to the walk below */
+    if (channel && (member || IsNetAdmin(sptr)) && !channel->names_stale)
+    {
+        wol_reply reply;
+        wol_names_chunk *chunk;
+        char prefix[BUFSIZE];
+        int prefix_len;
+
+        prefix_len = snprintf(prefix, sizeof(prefix), ":%s %d %s %c %s :",
+                me.name,
+                RPL_NAMREPLY,
+                parv[0],
+                PubChannel(chptr) ? '=' : SecretChannel(chptr) ? '@' : '*',
+                chptr->chname);
+
+        wol_reply_init(&reply, sptr);
+
+        if (channel->names.first == NULL)
+            wol_reply_line(&reply, prefix, prefix_len, "", 0);
+
+        WOL_DLIST_FOREACH(channel->names, chunk, link)
+        {
+            wol_reply_line(&reply, prefix, prefix_len, chunk->data, chunk->len);
+        }
+
+        wol_reply_printf(&reply, rpl_str(RPL_ENDOFNAMES), me.name, parv[0], para);
+        wol_reply_flush(&reply);
+
+        return 0;
+    }
+
     if (PubChannel(chptr))
         buf[0] = '=';
     else if (SecretChannel(chptr))
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Builds the account database for wol::accounts from a text list.
+
+   usage: wol_accounts list.txt accounts.db
+
+   One "nick password" per line, empty lines and lines starting with # are
+   skipped. The password is APGAR encoded here so the server only compares
+   what the client sends. A nick listed twice keeps its first password. The
+   database is written to a temporary file and renamed over the old one so
+   a running server never maps a half written file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../wol_account.h"
+
+/* the client side encoding of APGAR, "test" is "0aIraaaa" */
+static void apgar(char *out, const char *password)
+{
+    static const char lookup[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789./";
+    unsigned char left, right;
+    int len = strlen(password), i;
+
+    if (len > WOL_ACCOUNT_APGAR)
+        len = WOL_ACCOUNT_APGAR;
+
+    for (i = 0; i < WOL_ACCOUNT_APGAR; i++)
+    {
+        left = i < len ? password[i] : 0;
+        right = i < len ? password[len - i] : 0;
+
+        if (left & 1)
+            out[i] = lookup[((left << 1) & right) & 63];
+        else
+            out[i] = lookup[(left ^ right) & 63];
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    char line[1024];
+    char tmp[1024];
+    char nick[256], password[256];
+    wol_account *records = NULL;
+    uint32_t *buckets, *bucket, i, j;
+    wol_account_header header;
+    size_t count = 0, size = 0, unique, skipped = 0;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s list.txt accounts.db\n", argv[0]);
+        return 1;
+    }
+
+    if ((in = fopen(argv[1], "r")) == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), in))
+    {
+        if (*line == '#' || sscanf(line, "%255s %255s", nick, password) != 2)
+            continue;
+
+        if (count == size)
+        {
+            size = size ? size * 2 : 65536;
+            records = realloc(records, size * sizeof(wol_account));
+            if (records == NULL)
+            {
+                perror("realloc");
+                return 1;
+            }
+        }
+
+        memset(&records[count], 0, sizeof(wol_account));
+
+        if (wol_account_key(records[count].nick, nick) == 0)
+        {
+            skipped++;
+            continue;
+        }
+
+        apgar(records[count].apgar, password);
+        count++;
+    }
+
+    fclose(in);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WOL_ACCOUNT_MAGIC;
+    header.version = WOL_ACCOUNT_VERSION;
+    for (header.buckets = 64; header.buckets < count; header.buckets <<= 1);
+
+    buckets = calloc(header.buckets, sizeof(uint32_t));
+
+    /* drop the later of two equal nicks while chaining in list order */
+    for (unique = 0, i = 0; i < count; i++)
+    {
+        bucket = &buckets[wol_account_hash(records[i].nick) & (header.buckets - 1)];
+
+        for (j = *bucket; j; j = records[j - 1].next)
+        {
+            if (!memcmp(records[j - 1].nick, records[i].nick, WOL_ACCOUNT_NICKLEN))
+                break;
+        }
+
+        if (j)
+            continue;
+
+        records[unique] = records[i];
+        records[unique].next = *bucket;
+        *bucket = ++unique;
+    }
+
+    /* the chains are built again back to front so every link points
+       forward and a corrupt file can't make a loop */
+    memset(buckets, 0, header.buckets * sizeof(uint32_t));
+
+    for (i = unique; i > 0; i--)
+    {
+        bucket = &buckets[wol_account_hash(records[i - 1].nick) & (header.buckets - 1)];
+        records[i - 1].next = *bucket;
+        *bucket = i;
+    }
+
+    header.count = unique;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", argv[2]);
+
+    if ((out = fopen(tmp, "wb")) == NULL)
+    {
+        perror(tmp);
+        return 1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(buckets, sizeof(uint32_t), header.buckets, out) != header.buckets
+        || (unique && fwrite(records, sizeof(wol_account), unique, out) != unique)
+        || fclose(out) != 0
+        || rename(tmp, argv[2]) < 0)
+    {
+        perror(argv[2]);
+        remove(tmp);
+        return 1;
+    }
+
+    printf("%s: %lu accounts, %lu duplicates, %lu nicks too long, %u buckets\n",
+            argv[2], (unsigned long)unique, (unsigned long)(count - unique),
+            (unsigned long)skipped, header.buckets);
+
+    free(buckets);
+    free(records);
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Dumps the game log written for wol::game-log, one line per game.
+
+   usage: wol_games [-c] [-r room] [-n nick] [-i ip] [-t type] [-s since] [-u until] games.log...
+
+   -r and -n match case insensitively, -i matches the start of an address
+   so "10.0." finds a whole network. -s and -u are unix times. With -c only
+   the number of matching games is printed. A file that ends in a record
+   cut short by a crash is read up to it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "../wol_game.h"
+
+static const char *room_filter, *nick_filter, *ip_filter;
+static long type_filter = -1, since = -1, until = -1;
+static int count_only;
+static unsigned long matched;
+
+static int match(const wol_game_record *rec, const char *room, const wol_game_player *players)
+{
+    int i, nick = !nick_filter, ip = !ip_filter;
+
+    if ((type_filter >= 0 && rec->type != type_filter)
+        || (since >= 0 && rec->time < since)
+        || (until >= 0 && rec->time > until)
+        || (room_filter && strcasecmp(room, room_filter)))
+        return 0;
+
+    for (i = 0; i < rec->players; i++)
+    {
+        if (nick_filter && !strcasecmp(players[i].name, nick_filter))
+            nick = 1;
+        if (ip_filter && !strncmp(players[i].ip, ip_filter, strlen(ip_filter)))
+            ip = 1;
+    }
+
+    return nick && ip;
+}
+
+static void print(const wol_game_record *rec, const char *room, const wol_game_player *players)
+{
+    char stamp[32];
+    time_t t = rec->time;
+    int i;
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    printf("%s %s type %u SKU %u:", stamp, room, rec->type, rec->SKU);
+
+    for (i = 0; i < rec->players; i++)
+        printf("%s %s %s", i ? "," : "", players[i].name, players[i].ip);
+
+    printf("\n");
+}
+
+static int dump(const char *path)
+{
+    static uint8_t buf[WOL_GAME_MAX];
+    static wol_game_player players[255];
+    wol_game_record *rec = (wol_game_record *)buf;
+    wol_game_header header;
+    char room[256];
+    long offset;
+    FILE *fp;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || header.magic != WOL_GAME_MAGIC || header.version != WOL_GAME_VERSION)
+    {
+        fprintf(stderr, "%s: not a game log\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    for (offset = sizeof(header); fread(&rec->len, sizeof(rec->len), 1, fp) == 1; offset += rec->len)
+    {
+        if (rec->len < sizeof(wol_game_record) || rec->len > WOL_GAME_MAX
+            || fread(buf + sizeof(rec->len), rec->len - sizeof(rec->len), 1, fp) != 1
+            || !wol_game_parse(buf, room, players))
+        {
+            fprintf(stderr, "%s: record cut short at %ld\n", path, offset);
+            break;
+        }
+
+        if (match(rec, room, players))
+        {
+            matched++;
+            if (!count_only)
+                print(rec, room, players);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0, c;
+
+    while ((c = getopt(argc, argv, "cr:n:i:t:s:u:")) != -1)
+    {
+        switch (c)
+        {
+            case 'c':   count_only = 1; break;
+            case 'r':   room_filter = optarg; break;
+            case 'n':   nick_filter = optarg; break;
+            case 'i':   ip_filter = optarg; break;
+            case 't':   type_filter = atol(optarg); break;
+            case 's':   since = atol(optarg); break;
+            case 'u':   until = atol(optarg); break;
+            default:    optind = argc + 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-c] [-r room] [-n nick] [-i ip] [-t type] [-s since] [-u until] games.log...\n", argv[0]);
+        return 1;
+    }
+
+    for (; optind < argc; optind++)
+        ret |= dump(argv[optind]);
+
+    if (count_only)
+        printf("%lu\n", matched);
+
+    return ret;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Builds the banned serial database for wol::serials from a text list.
+
+   usage: wol_serials list.txt serials.db
+
+   One serial per line, dashes and spaces are ignored. Empty lines and lines
+   starting with # are skipped, duplicates are written once. The database is
+   written to a temporary file and renamed over the old one so a running
+   server never maps a half written file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../wol_serial.h"
+
+static int cmp_key(const void *a, const void *b)
+{
+    return memcmp(a, b, WOL_SERIAL_LEN);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    char line[1024];
+    char tmp[1024];
+    char *keys = NULL;
+    uint8_t *bloom;
+    wol_serial_header header;
+    size_t count = 0, size = 0, unique, i;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s list.txt serials.db\n", argv[0]);
+        return 1;
+    }
+
+    if ((in = fopen(argv[1], "r")) == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), in))
+    {
+        if (*line == '#')
+            continue;
+
+        if (count == size)
+        {
+            size = size ? size * 2 : 65536;
+            keys = realloc(keys, size * WOL_SERIAL_LEN);
+            if (keys == NULL)
+            {
+                perror("realloc");
+                return 1;
+            }
+        }
+
+        if (wol_serial_key(keys + count * WOL_SERIAL_LEN, line) > 0)
+            count++;
+    }
+
+    fclose(in);
+
+    qsort(keys, count, WOL_SERIAL_LEN, cmp_key);
+
+    for (unique = 0, i = 0; i < count; i++)
+    {
+        if (unique && !memcmp(keys + (unique - 1) * WOL_SERIAL_LEN, keys + i * WOL_SERIAL_LEN, WOL_SERIAL_LEN))
+            continue;
+        memmove(keys + unique * WOL_SERIAL_LEN, keys + i * WOL_SERIAL_LEN, WOL_SERIAL_LEN);
+        unique++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WOL_SERIAL_MAGIC;
+    header.version = WOL_SERIAL_VERSION;
+    header.count = unique;
+    header.hashes = WOL_SERIAL_HASHES;
+    for (header.bloom_bits = 64; header.bloom_bits < unique * WOL_SERIAL_BITS; header.bloom_bits <<= 1);
+
+    bloom = calloc(header.bloom_bits / 8, 1);
+    for (i = 0; i < unique; i++)
+        wol_serial_bloom_add(bloom, header.bloom_bits, header.hashes, keys + i * WOL_SERIAL_LEN);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", argv[2]);
+
+    if ((out = fopen(tmp, "wb")) == NULL)
+    {
+        perror(tmp);
+        return 1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(bloom, header.bloom_bits / 8, 1, out) != 1
+        || (unique && fwrite(keys, WOL_SERIAL_LEN, unique, out) != unique)
+        || fclose(out) != 0
+        || rename(tmp, argv[2]) < 0)
+    {
+        perror(argv[2]);
+        remove(tmp);
+        return 1;
+    }
+
+    printf("%s: %lu serials, %lu duplicates, %u filter bits\n",
+            argv[2], (unsigned long)unique, (unsigned long)(count - unique), header.bloom_bits);
+
+    free(bloom);
+    free(keys);
+
+    return 0;
+}
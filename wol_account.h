@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Account database shared by the module and tools/wol_accounts which builds
+   it from a list of nicks and passwords.
+
+   The file is a header, a bucket table and fixed size records chained from
+   the buckets, so a nick is found straight from an mmap with one hash and a
+   short chain walk. Records hold the nick in lower case and the password
+   already APGAR encoded the way the client sends it.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#define WOL_ACCOUNT_MAGIC   0x414C4F57      /* WOLA */
+#define WOL_ACCOUNT_VERSION 1
+#define WOL_ACCOUNT_NICKLEN 32              /* zero padded, longer nicks don't fit */
+#define WOL_ACCOUNT_APGAR   8
+
+typedef struct wol_account_header
+{
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            count;              /* records */
+    uint32_t            buckets;            /* power of two */
+} wol_account_header;
+
+typedef struct wol_account
+{
+    char                nick[WOL_ACCOUNT_NICKLEN];
+    char                apgar[WOL_ACCOUNT_APGAR];
+    uint32_t            next;               /* record + 1 in the same bucket, 0 ends */
+    uint32_t            reserved;
+} wol_account;
+
+/* the buckets follow the header and hold record + 1, the records follow them */
+#define WOL_ACCOUNT_BUCKETS(h)  ((const uint32_t *)((h) + 1))
+#define WOL_ACCOUNT_RECORDS(h)  ((const wol_account *)(WOL_ACCOUNT_BUCKETS(h) + (h)->buckets))
+#define WOL_ACCOUNT_SIZE(h)                                 \
+    (sizeof(wol_account_header) + (size_t)(h)->buckets * sizeof(uint32_t) + (size_t)(h)->count * sizeof(wol_account))
+
+/* lower cases with the rfc1459 mapping the ircd uses, 0 if it doesn't fit */
+static inline int wol_account_key(char *key, const char *nick)
+{
+    int len;
+
+    memset(key, 0, WOL_ACCOUNT_NICKLEN);
+
+    for (len = 0; nick[len]; len++)
+    {
+        if (len == WOL_ACCOUNT_NICKLEN)
+            return 0;
+
+        switch (nick[len])
+        {
+            case '[':   key[len] = '{'; break;
+            case ']':   key[len] = '}'; break;
+            case '\\':  key[len] = '|'; break;
+            case '~':   key[len] = '^'; break;
+            default:    key[len] = tolower((unsigned char)nick[len]);
+        }
+    }
+
+    return len;
+}
+
+/* FNV-1a over the whole key */
+static inline uint32_t wol_account_hash(const char *key)
+{
+    uint32_t h = 0x811C9DC5;
+    int i;
+
+    for (i = 0; i < WOL_ACCOUNT_NICKLEN; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/* checks the size and every chain link of a mapped file before use */
+static inline int wol_account_valid(const wol_account_header *header, size_t size)
+{
+    const uint32_t *buckets;
+    const wol_account *records;
+    uint32_t i;
+
+    if (size < sizeof(wol_account_header)
+        || header->magic != WOL_ACCOUNT_MAGIC
+        || header->version != WOL_ACCOUNT_VERSION
+        || header->buckets == 0
+        || (header->buckets & (header->buckets - 1)) != 0
+        || size != WOL_ACCOUNT_SIZE(header))
+        return 0;
+
+    buckets = WOL_ACCOUNT_BUCKETS(header);
+    records = WOL_ACCOUNT_RECORDS(header);
+
+    /* links only point forward so a chain always ends */
+    for (i = 0; i < header->buckets; i++)
+    {
+        if (buckets[i] > header->count)
+            return 0;
+    }
+
+    for (i = 0; i < header->count; i++)
+    {
+        if (records[i].next && (records[i].next <= i + 1 || records[i].next > header->count))
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline const wol_account *wol_account_find(const wol_account_header *header, const char *key)
+{
+    const wol_account *records = WOL_ACCOUNT_RECORDS(header);
+    uint32_t i = WOL_ACCOUNT_BUCKETS(header)[wol_account_hash(key) & (header->buckets - 1)];
+
+    for (; i; i = records[i - 1].next)
+    {
+        if (!memcmp(records[i - 1].nick, key, WOL_ACCOUNT_NICKLEN))
+            return &records[i - 1];
+    }
+
+    return NULL;
+}
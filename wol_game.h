@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Game log shared by the module, which appends a record for every STARTG,
+   and tools/wol_games which dumps and filters it.
+
+   A file is a header and records back to back, each starting with its own
+   length. After the fixed part come the room name and then the players,
+   every string as a length byte and the bytes. Numbers are in host byte
+   order, the log is read on the machine that wrote it. A crash can leave
+   the last record cut short, every writer starts a new file so that only
+   ever happens at the end of one.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#define WOL_GAME_MAGIC      0x474C4F57      /* WOLG */
+#define WOL_GAME_VERSION    1
+#define WOL_GAME_MAX        16384           /* record size, players that don't fit are left out */
+
+typedef struct wol_game_header
+{
+    uint32_t            magic;
+    uint32_t            version;
+} wol_game_header;
+
+typedef struct wol_game_record
+{
+    uint32_t            len;                /* the whole record, this included */
+    uint32_t            time;               /* STARTG, unix time */
+    uint32_t            SKU;                /* of the host */
+    uint16_t            type;               /* game type of the room */
+    uint8_t             players;
+    uint8_t             reserved;
+} wol_game_record;
+
+typedef struct wol_game_player
+{
+    char                name[256];
+    char                ip[256];
+} wol_game_player;
+
+/* appends a length byte and the string, the caller has checked the room */
+static inline uint8_t *wol_game_put(uint8_t *p, const char *str, int len)
+{
+    if (len > 255)
+        len = 255;
+
+    *p++ = len;
+    memcpy(p, str, len);
+
+    return p + len;
+}
+
+/* copies out a string, NULL if it runs past the end of the record */
+static inline const uint8_t *wol_game_get(const uint8_t *p, const uint8_t *end, char *out)
+{
+    if (p >= end || p + 1 + *p > end)
+        return NULL;
+
+    memcpy(out, p + 1, *p);
+    out[*p] = '\0';
+
+    return p + 1 + *p;
+}
+
+/* unpacks a whole record read from a file, 0 if it isn't one */
+static inline int wol_game_parse(const uint8_t *buf, char *room, wol_game_player *players)
+{
+    const wol_game_record *rec = (const wol_game_record *)buf;
+    const uint8_t *p = buf + sizeof(wol_game_record), *end = buf + rec->len;
+    int i;
+
+    if (rec->len < sizeof(wol_game_record) || rec->len > WOL_GAME_MAX)
+        return 0;
+
+    if ((p = wol_game_get(p, end, room)) == NULL)
+        return 0;
+
+    for (i = 0; i < rec->players; i++)
+    {
+        if ((p = wol_game_get(p, end, players[i].name)) == NULL
+            || (p = wol_game_get(p, end, players[i].ip)) == NULL)
+            return 0;
+    }
+
+    return p == end;
+}
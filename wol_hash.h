@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Pointer keyed open addressing hash map with linear probing.
+
+   The table never grows in one go: when it gets half full a table of twice
+   the size is allocated and the old slots are moved over a few at a time on
+   every following insert or delete, so a resize never stalls the event loop.
+   Lookups check the new table first and the old one while it is drained.
+
+   Keys can be any non-NULL pointer sized value.
+*/
+
+#include <stdint.h>
+
+#define WOL_HASH_MIN_SIZE   64
+#define WOL_HASH_MIGRATE    32
+
+typedef struct wol_hash_slot
+{
+    const void          *key;
+    void                *value;
+} wol_hash_slot;
+
+typedef struct wol_hash
+{
+    wol_hash_slot       *slots;
+    unsigned int        size;
+    unsigned int        used;
+    wol_hash_slot       *old;       /* previous table while resizing */
+    unsigned int        old_size;
+    unsigned int        old_pos;    /* next old slot to move */
+    unsigned int        count;      /* live entries in both tables */
+} wol_hash;
+
+/* marks a moved or deleted slot in the old table so probing continues */
+static const char wol_hash_tombstone;
+
+static unsigned int wol_hash_index(const void *key, unsigned int size)
+{
+    uint64_t h = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+    return (unsigned int)(h >> 32) & (size - 1);
+}
+
+static wol_hash_slot *wol_hash_find(wol_hash_slot *slots, unsigned int size, const void *key)
+{
+    unsigned int i, n;
+
+    if (slots == NULL)
+        return NULL;
+
+    /* the old table can fill up with tombstones, so don't probe forever */
+    for (i = wol_hash_index(key, size), n = 0; slots[i].key && n < size; i = (i + 1) & (size - 1), n++)
+    {
+        if (slots[i].key == key)
+            return &slots[i];
+    }
+
+    return NULL;
+}
+
+static void wol_hash_insert(wol_hash *hash, const void *key, void *value)
+{
+    unsigned int i = wol_hash_index(key, hash->size);
+
+    while (hash->slots[i].key)
+        i = (i + 1) & (hash->size - 1);
+
+    hash->slots[i].key = key;
+    hash->slots[i].value = value;
+    hash->used++;
+}
+
+/* backward shift deletion keeps probe chains intact without tombstones */
+static void wol_hash_remove(wol_hash *hash, unsigned int i)
+{
+    unsigned int mask = hash->size - 1;
+    unsigned int j = i, k;
+
+    for (;;)
+    {
+        hash->slots[i].key = NULL;
+        hash->slots[i].value = NULL;
+
+        do
+        {
+            j = (j + 1) & mask;
+            if (hash->slots[j].key == NULL)
+            {
+                hash->used--;
+                return;
+            }
+            k = wol_hash_index(hash->slots[j].key, hash->size);
+        } while ((i <= j) ? (i < k && k <= j) : (i < k || k <= j));
+
+        hash->slots[i] = hash->slots[j];
+        i = j;
+    }
+}
+
+static void wol_hash_migrate(wol_hash *hash, unsigned int steps)
+{
+    wol_hash_slot *slot;
+
+    while (hash->old && steps--)
+    {
+        slot = &hash->old[hash->old_pos];
+
+        if (slot->key && slot->key != &wol_hash_tombstone)
+            wol_hash_insert(hash, slot->key, slot->value);
+
+        if (++hash->old_pos == hash->old_size)
+        {
+            free(hash->old);
+            hash->old = NULL;
+            hash->old_size = 0;
+            hash->old_pos = 0;
+        }
+        else if (slot->key)
+        {
+            slot->key = &wol_hash_tombstone;
+        }
+    }
+}
+
+static int wol_hash_grow(wol_hash *hash)
+{
+    unsigned int size = hash->size ? hash->size * 2 : WOL_HASH_MIN_SIZE;
+    wol_hash_slot *slots;
+
+    /* finish a pending resize first, this only happens if we grow too fast */
+    wol_hash_migrate(hash, hash->old_size);
+
+    slots = calloc(size, sizeof(wol_hash_slot));
+    if (slots == NULL)
+        return 0;
+
+    hash->old = hash->slots;
+    hash->old_size = hash->old ? hash->size : 0;
+    hash->old_pos = 0;
+    hash->slots = slots;
+    hash->size = size;
+    hash->used = 0;
+
+    return 1;
+}
+
+static void wol_hash_init(wol_hash *hash)
+{
+    memset(hash, 0, sizeof(wol_hash));
+}
+
+static void wol_hash_free(wol_hash *hash)
+{
+    free(hash->slots);
+    free(hash->old);
+    wol_hash_init(hash);
+}
+
+static void *wol_hash_get(wol_hash *hash, const void *key)
+{
+    wol_hash_slot *slot;
+
+    if (key == NULL)
+        return NULL;
+
+    if ((slot = wol_hash_find(hash->slots, hash->size, key)))
+        return slot->value;
+
+    if ((slot = wol_hash_find(hash->old, hash->old_size, key)))
+        return slot->value;
+
+    return NULL;
+}
+
+static void *wol_hash_del(wol_hash *hash, const void *key)
+{
+    wol_hash_slot *slot;
+    void *value = NULL;
+
+    if (key == NULL)
+        return NULL;
+
+    wol_hash_migrate(hash, WOL_HASH_MIGRATE);
+
+    if ((slot = wol_hash_find(hash->slots, hash->size, key)))
+    {
+        value = slot->value;
+        wol_hash_remove(hash, slot - hash->slots);
+        hash->count--;
+    }
+    else if ((slot = wol_hash_find(hash->old, hash->old_size, key)))
+    {
+        value = slot->value;
+        slot->key = &wol_hash_tombstone;
+        slot->value = NULL;
+        hash->count--;
+    }
+
+    return value;
+}
+
+static int wol_hash_put(wol_hash *hash, const void *key, void *value)
+{
+    wol_hash_slot *slot;
+
+    if (key == NULL)
+        return 0;
+
+    wol_hash_migrate(hash, WOL_HASH_MIGRATE);
+
+    if ((slot = wol_hash_find(hash->slots, hash->size, key)))
+    {
+        slot->value = value;
+        return 1;
+    }
+
+    if ((hash->used + 1) * 2 > hash->size && !wol_hash_grow(hash))
+        return 0;
+
+    /* an entry still in the old table goes once there is room for the new
+       one, after a grow it is in the table that just became the old one */
+    if ((slot = wol_hash_find(hash->old, hash->old_size, key)))
+    {
+        slot->key = &wol_hash_tombstone;
+        slot->value = NULL;
+        hash->count--;
+    }
+
+    wol_hash_insert(hash, key, value);
+    hash->count++;
+
+    return 1;
+}
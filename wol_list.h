@@ -82,3 +82,156 @@
         } while(el);                                        \
         (el) = _eltmp;                                      \
     }
+
+/*
+   Intrusive doubly linked list with a tail pointer, append and unlink are
+   O(1). The links live in a WOL_DLIST_ENTRY member of the element so one
+   element can be on several lists at once, field names that member.
+*/
+
+#define WOL_DLIST_HEAD(type)                                \
+    struct { type *first; type *last; }
+
+#define WOL_DLIST_ENTRY(type)                               \
+    struct { type *prev; type *next; }
+
+#define WOL_DLIST_LINKED(list, el, field)                   \
+    ((el)->field.prev != NULL || (list).first == (el))
+
+#define WOL_DLIST_APPEND(list, el, field)                   \
+    do {                                                    \
+        (el)->field.next = NULL;                            \
+        (el)->field.prev = (list).last;                     \
+        if ((list).last)                                    \
+            (list).last->field.next = (el);                 \
+        else                                                \
+            (list).first = (el);                            \
+        (list).last = (el);                                 \
+    } while (0)
+
+#define WOL_DLIST_UNLINK(list, el, field)                   \
+    do {                                                    \
+        if ((el)->field.prev)                               \
+            (el)->field.prev->field.next = (el)->field.next;\
+        else                                                \
+            (list).first = (el)->field.next;                \
+        if ((el)->field.next)                               \
+            (el)->field.next->field.prev = (el)->field.prev;\
+        else                                                \
+            (list).last = (el)->field.prev;                 \
+        (el)->field.prev = NULL;                            \
+        (el)->field.next = NULL;                            \
+    } while (0)
+
+#define WOL_DLIST_FOREACH(list, el, field)                  \
+    for ((el) = (list).first; (el) != NULL; (el) = (el)->field.next)
+
+/* el may be unlinked and freed inside the loop body */
+#define WOL_DLIST_FOREACH_SAFE(list, el, tmp, field)        \
+    for ((el) = (list).first;                               \
+        (el) != NULL && ((tmp) = (el)->field.next, 1);      \
+        (el) = (tmp))
+
+#define WOL_DLIST_FREE(list, field)                         \
+    while ((list).first)                                    \
+    {                                                       \
+        void *_eltmp = (list).first;                        \
+        (list).first = (list).first->field.next;            \
+        free(_eltmp);                                       \
+    }                                                       \
+    (list).last = NULL
+
+#define WOL_DLIST_INIT(list)                                \
+    (list).first = (list).last = NULL
+
+/*
+   Fixed size object pool. Objects are carved out of page sized chunks and
+   recycled through a free list threaded through the free objects themselves,
+   all chunks are released at once by wol_pool_destroy().
+*/
+
+#define WOL_POOL_CHUNK      4096
+#define WOL_POOL_ALIGN      16
+
+#define WOL_POOL_ROUND(size)                                \
+    (((size) + WOL_POOL_ALIGN - 1) & ~(size_t)(WOL_POOL_ALIGN - 1))
+
+#define WOL_POOL_INITIALIZER(type)                          \
+    { WOL_POOL_ROUND(sizeof(type)), NULL, NULL, 0, 0, 0 }
+
+typedef struct wol_pool
+{
+    size_t              size;
+    void                *free;
+    void                *chunks;
+    unsigned int        nchunks;
+    unsigned int        live;
+    unsigned int        peak;
+} wol_pool;
+
+static int wol_pool_grow(wol_pool *pool)
+{
+    size_t header = WOL_POOL_ROUND(sizeof(void *));
+    size_t len = WOL_POOL_CHUNK;
+    char *chunk, *obj;
+
+    if (header + pool->size > len)
+        len = header + pool->size;
+
+    chunk = malloc(len);
+    if (chunk == NULL)
+        return 0;
+
+    *(void **)chunk = pool->chunks;
+    pool->chunks = chunk;
+    pool->nchunks++;
+
+    for (obj = chunk + header; obj + pool->size <= chunk + len; obj += pool->size)
+    {
+        *(void **)obj = pool->free;
+        pool->free = obj;
+    }
+
+    return 1;
+}
+
+static void *wol_pool_alloc(wol_pool *pool)
+{
+    void *obj;
+
+    if (pool->free == NULL && !wol_pool_grow(pool))
+        return NULL;
+
+    obj = pool->free;
+    pool->free = *(void **)obj;
+    memset(obj, 0, pool->size);
+
+    if (++pool->live > pool->peak)
+        pool->peak = pool->live;
+
+    return obj;
+}
+
+static void wol_pool_free(wol_pool *pool, void *obj)
+{
+    if (obj == NULL)
+        return;
+
+    *(void **)obj = pool->free;
+    pool->free = obj;
+    pool->live--;
+}
+
+static void wol_pool_destroy(wol_pool *pool)
+{
+    while (pool->chunks)
+    {
+        void *chunk = pool->chunks;
+        pool->chunks = *(void **)chunk;
+        free(chunk);
+    }
+
+    pool->free = NULL;
+    pool->nchunks = 0;
+    pool->live = 0;
+}
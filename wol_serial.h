@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Banned serial database shared by the module and tools/wol_serials which
+   builds it from a text list.
+
+   The file is a header, a Bloom filter and the keys sorted as fixed size
+   records, so it can be used straight from an mmap. A key is the serial
+   with everything but letters and digits dropped and letters upper cased.
+   Most serials aren't banned and stop at the filter, the rest are looked
+   up with a binary search.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#define WOL_SERIAL_MAGIC    0x4B4C4F57      /* WOLK */
+#define WOL_SERIAL_VERSION  1
+#define WOL_SERIAL_LEN      32              /* record size, longer keys are cut */
+#define WOL_SERIAL_HASHES   7               /* bits set per key, ~1% false positives */
+#define WOL_SERIAL_BITS     10              /* filter bits per key, rounded up to 2^n */
+
+typedef struct wol_serial_header
+{
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            count;              /* keys */
+    uint32_t            bloom_bits;         /* power of two */
+    uint32_t            hashes;
+    uint32_t            reserved;
+} wol_serial_header;
+
+/* the filter follows the header, the keys follow the filter */
+#define WOL_SERIAL_BLOOM(h)     ((const uint8_t *)((h) + 1))
+#define WOL_SERIAL_KEYS(h)      ((const char *)(WOL_SERIAL_BLOOM(h) + (h)->bloom_bits / 8))
+#define WOL_SERIAL_SIZE(h)                                  \
+    (sizeof(wol_serial_header) + (h)->bloom_bits / 8 + (size_t)(h)->count * WOL_SERIAL_LEN)
+
+/* returns the key length, key is zero padded to WOL_SERIAL_LEN */
+static inline int wol_serial_key(char *key, const char *serial)
+{
+    int len = 0;
+
+    memset(key, 0, WOL_SERIAL_LEN);
+
+    for (; *serial && len < WOL_SERIAL_LEN; serial++)
+    {
+        if (isalnum((unsigned char)*serial))
+            key[len++] = toupper((unsigned char)*serial);
+    }
+
+    return len;
+}
+
+/* FNV-1a over the whole record */
+static inline uint64_t wol_serial_hash(const char *key)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    int i;
+
+    for (i = 0; i < WOL_SERIAL_LEN; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001B3ULL;
+    }
+
+    return h;
+}
+
+/* the k bit positions come from the two halves of the hash */
+#define WOL_SERIAL_BIT(hash, i, bits)                       \
+    (((uint32_t)(hash) + (i) * (uint32_t)((hash) >> 32)) & ((bits) - 1))
+
+static inline void wol_serial_bloom_add(uint8_t *bloom, uint32_t bits, uint32_t hashes, const char *key)
+{
+    uint64_t h = wol_serial_hash(key);
+    uint32_t i, bit;
+
+    for (i = 0; i < hashes; i++)
+    {
+        bit = WOL_SERIAL_BIT(h, i, bits);
+        bloom[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+/* checks the size of a mapped file before anything else is read from it */
+static inline int wol_serial_valid(const wol_serial_header *header, size_t size)
+{
+    return size >= sizeof(wol_serial_header)
+        && header->magic == WOL_SERIAL_MAGIC
+        && header->version == WOL_SERIAL_VERSION
+        && header->bloom_bits >= 8
+        && (header->bloom_bits & (header->bloom_bits - 1)) == 0
+        && header->hashes > 0
+        && size == WOL_SERIAL_SIZE(header);
+}
+
+static inline int wol_serial_find(const wol_serial_header *header, const char *key)
+{
+    const uint8_t *bloom = WOL_SERIAL_BLOOM(header);
+    const char *keys = WOL_SERIAL_KEYS(header);
+    uint64_t h = wol_serial_hash(key);
+    uint32_t i, bit, lo = 0, hi = header->count;
+    int cmp;
+
+    for (i = 0; i < header->hashes; i++)
+    {
+        bit = WOL_SERIAL_BIT(h, i, header->bloom_bits);
+        if (!(bloom[bit >> 3] & (1 << (bit & 7))))
+            return 0;
+    }
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        cmp = memcmp(key, keys + (size_t)mid * WOL_SERIAL_LEN, WOL_SERIAL_LEN);
+        if (cmp == 0)
+            return 1;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return 0;
+}
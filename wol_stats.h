@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Per command counters and latency histograms. Latencies are taken from the
+   monotonic clock and counted in power of two buckets of nanoseconds, bucket
+   n holds calls that took less than 2^n ns.
+*/
+
+#include <stdint.h>
+#include <time.h>
+
+#define WOL_STAT_LIST       0
+#define WOL_STAT_JOIN       1
+#define WOL_STAT_JOINGAME   2
+#define WOL_STAT_NAMES      3
+#define WOL_STAT_STARTG     4
+#define WOL_STAT_GAMEOPT    5
+#define WOL_STAT_MAX        6
+
+#define WOL_STATS_BUCKETS   36
+
+typedef struct wol_stats_cmd
+{
+    const char          *name;
+    unsigned long       calls;
+    uint64_t            bytes;      /* reply bytes queued to the caller */
+    uint64_t            ns;
+    uint64_t            max_ns;
+    unsigned long       hist[WOL_STATS_BUCKETS];
+} wol_stats_cmd;
+
+static wol_stats_cmd wol_stats[WOL_STAT_MAX] =
+{
+    { "LIST" },
+    { "JOIN" },
+    { "JOINGAME" },
+    { "NAMES" },
+    { "STARTG" },
+    { "GAMEOPT" },
+};
+
+static uint64_t wol_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void wol_stats_record(int cmd, uint64_t ns, unsigned long bytes)
+{
+    wol_stats_cmd *stat = &wol_stats[cmd];
+    int bucket = 0;
+
+    while (bucket < WOL_STATS_BUCKETS - 1 && (ns >> bucket))
+        bucket++;
+
+    stat->calls++;
+    stat->bytes += bytes;
+    stat->ns += ns;
+    stat->hist[bucket]++;
+
+    if (ns > stat->max_ns)
+        stat->max_ns = ns;
+}
+
+/* upper bound in ns of the bucket where pct percent of the calls fall */
+static uint64_t wol_stats_percentile(wol_stats_cmd *stat, int pct)
+{
+    unsigned long want = (stat->calls * pct + 99) / 100, seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < WOL_STATS_BUCKETS; bucket++)
+    {
+        seen += stat->hist[bucket];
+        if (seen >= want && seen)
+            return 1ULL << bucket;
+    }
+
+    return 0;
+}
+
+static void wol_stats_reset(void)
+{
+    int i;
+
+    for (i = 0; i < WOL_STAT_MAX; i++)
+    {
+        const char *name = wol_stats[i].name;
+        memset(&wol_stats[i], 0, sizeof(wol_stats_cmd));
+        wol_stats[i].name = name;
+    }
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2011 Toni Spets <toni.spets@iki.fi>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+   Trace points that write into an in-memory ring of recent events instead of
+   the ircd log. A trace point costs a compare against the runtime level and
+   category mask when it is off, and nothing at all when the module is built
+   with -DWOL_NO_TRACE. Only errors are copied to the ircd log.
+
+   Writers claim a ring slot with an atomic increment and publish it by
+   storing its sequence number last, so a reader can skip slots that are
+   being overwritten while it dumps the ring.
+*/
+
+#include <stdarg.h>
+#include <sys/time.h>
+
+#define WOL_TRACE_ERROR     1
+#define WOL_TRACE_WARN      2
+#define WOL_TRACE_INFO      3
+#define WOL_TRACE_DEBUG     4
+
+#define WOL_TC_USER         0x01    /* login and quit */
+#define WOL_TC_LIST         0x02
+#define WOL_TC_CHAN         0x04    /* channels, JOIN and JOINGAME */
+#define WOL_TC_GAME         0x08    /* GAMEOPT and STARTG */
+#define WOL_TC_ALL          0xFF
+
+#define WOL_TRACE_RING      1024    /* power of two */
+#define WOL_TRACE_MSGLEN    148
+
+typedef struct wol_trace_entry
+{
+    volatile unsigned int seq;      /* slot index + 1 once complete */
+    unsigned char       level;
+    unsigned char       category;
+    struct timeval      tv;
+    char                msg[WOL_TRACE_MSGLEN];
+} wol_trace_entry;
+
+static int wol_trace_level = WOL_TRACE_WARN;
+static unsigned int wol_trace_mask = WOL_TC_ALL;
+static wol_trace_entry wol_trace_ring[WOL_TRACE_RING];
+static unsigned int wol_trace_head;
+
+#ifdef WOL_NO_TRACE
+
+#define WOL_TRACE_ON(cat, level)    0
+#define WOL_TRACE(cat, level, ...)  do { } while (0)
+#define WOL_TRACE_PARV(cat, cmd, sptr, parc, parv) do { } while (0)
+
+#else
+
+#define WOL_TRACE_ON(cat, level)                            \
+    ((level) <= wol_trace_level && ((cat) & wol_trace_mask))
+
+#define WOL_TRACE(cat, level, ...)                          \
+    do {                                                    \
+        if (WOL_TRACE_ON(cat, level))                       \
+            wol_trace_write(cat, level, __VA_ARGS__);       \
+    } while (0)
+
+/* one line per command in the same shape the client sent it */
+#define WOL_TRACE_PARV(cat, cmd, sptr, parc, parv)          \
+    do {                                                    \
+        if (WOL_TRACE_ON(cat, WOL_TRACE_DEBUG))             \
+            wol_trace_parv(cat, cmd, sptr, parc, parv);     \
+    } while (0)
+
+#endif
+
+static wol_trace_entry *wol_trace_claim(int category, int level, unsigned int *idx)
+{
+    wol_trace_entry *entry;
+
+    *idx = __sync_fetch_and_add(&wol_trace_head, 1);
+    entry = &wol_trace_ring[*idx & (WOL_TRACE_RING - 1)];
+
+    entry->seq = 0;
+    __sync_synchronize();
+    entry->level = level;
+    entry->category = category;
+    gettimeofday(&entry->tv, NULL);
+
+    return entry;
+}
+
+static void wol_trace_publish(wol_trace_entry *entry, unsigned int idx)
+{
+    __sync_synchronize();
+    entry->seq = idx + 1;
+}
+
+#ifndef WOL_NO_TRACE
+
+static void wol_trace_write(int category, int level, const char *fmt, ...)
+{
+    unsigned int idx;
+    wol_trace_entry *entry = wol_trace_claim(category, level, &idx);
+    va_list vl;
+
+    va_start(vl, fmt);
+    vsnprintf(entry->msg, sizeof(entry->msg), fmt, vl);
+    va_end(vl);
+
+    wol_trace_publish(entry, idx);
+
+    if (level == WOL_TRACE_ERROR)
+        ircd_log(LOG_ERROR, "m_wol: %s", entry->msg);
+}
+
+static void wol_trace_parv(int category, const char *cmd, void *sptr, int parc, char *parv[])
+{
+    unsigned int idx;
+    wol_trace_entry *entry = wol_trace_claim(category, WOL_TRACE_DEBUG, &idx);
+    int i, len;
+
+    len = snprintf(entry->msg, sizeof(entry->msg), "%p %s %s", sptr, parc > 0 ? parv[0] : "*", cmd);
+
+    for (i = 1; i < parc && parv[i] && len < (int)sizeof(entry->msg); i++)
+    {
+        len += snprintf(entry->msg + len, sizeof(entry->msg) - len,
+                (i == parc - 1 && strchr(parv[i], ' ')) ? " :%s" : " %s", parv[i]);
+    }
+
+    wol_trace_publish(entry, idx);
+}
+
+#endif
+
+/* copies up to count of the most recent complete entries, oldest first */
+static int wol_trace_snapshot(wol_trace_entry *out, int count)
+{
+    unsigned int head = wol_trace_head, idx, n = 0;
+
+    if (count > WOL_TRACE_RING)
+        count = WOL_TRACE_RING;
+
+    idx = head > (unsigned int)count ? head - count : 0;
+
+    for (; idx != head; idx++)
+    {
+        wol_trace_entry *entry = &wol_trace_ring[idx & (WOL_TRACE_RING - 1)];
+
+        if (entry->seq != idx + 1)
+            continue;
+
+        out[n] = *entry;
+        __sync_synchronize();
+
+        if (entry->seq == idx + 1)
+            n++;
+    }
+
+    return n;
+}
+
+static void wol_trace_clear(void)
+{
+    memset(wol_trace_ring, 0, sizeof(wol_trace_ring));
+    wol_trace_head = 0;
+}